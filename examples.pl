@@ -14,5 +14,37 @@ for $file (<examples/*>){
 		}
 	}
 }
+# Streaming (-S) must make the same decisions as the event-driven loaded run
+# wherever the order of simultaneous events is defined: on one core, with
+# the distinct arrival times of the examples.
+for $file (<examples/*>){
+	if( $file =~ /proc(\d+)-c1-(\w+)\.out/){
+		`./simulator -c 1 -s $2 -e -v 1 examples/proc$1.csv | sed '1d' | grep -v '^FINAL TIMING\\|^  Core ' | cat -s > output1`;
+		`./simulator -c 1 -s $2 -S -v 1 examples/proc$1.csv | sed '1d' | cat -s > output2`;
+		$diff = `diff output1 output2`;
+		if($diff){
+			print "Streaming run of $file differs\n$diff";
+		}
+	}
+}
+# A field that does not fit in an int is malformed rather than wrapped around,
+# whether the trace is loaded or streamed.
+open(TRACE, '>', 'output2');
+print TRACE "\"Arrival time\",\"Run time\",\"Priority\"\n0,2147483647,1\n1,2147483648,1\n";
+close(TRACE);
+for $stream ('', '-S'){
+	$error = `./simulator -c 1 -s fcfs -v 0 $stream output2 2>&1 >/dev/null`;
+	if(($? >> 8) != 2 || $error !~ /line 3/){
+		print "Out-of-range field was not rejected by simulator $stream\n$error";
+	}
+}
+# A scheme with trailing characters is a usage error, not the scheme its
+# prefix names (rr3x is not rr3).
+for $program ('simulator', 'sweep'){
+	`./$program -c 1 -s rr3x examples/proc1.csv 2>&1`;
+	if(($? >> 8) != 1){
+		print "Scheme rr3x was not rejected by $program\n";
+	}
+}
 #cleanup
 `rm output1 output2`;
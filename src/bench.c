@@ -0,0 +1,466 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+#include <time.h>
+
+#include "libsimulator/libsimulator.h"
+#include "libpriqueue/libpriqueue.h"
+
+
+/*
+ * Benchmarks libpriqueue operations and scheduler decisions, printing one CSV row per measurement:
+ *
+ *   suite,subject,variant,size,op,ops,ns_per_op,ops_per_sec
+ *
+ * priqueue rows: subject is the backend, variant the comparer, size the number of elements held while
+ * op runs. scheduler rows: subject is the scheme, variant the queue mode, size the number of cores and
+ * op is "decision" (every sched_new_job, sched_job_finished and sched_quantum_expired call).
+ */
+
+/* Operations timed per round: the queue holds size elements before and after each round */
+#define BENCH_BATCH 1024
+
+/* Values are drawn from [0, BENCH_VALUES); bucket queues map them onto BENCH_LEVELS keys */
+#define BENCH_VALUES (1 << 20)
+#define BENCH_LEVELS 256
+
+static const int sizes[] = {16, 256, 4096, 65536};
+
+/* Filling a sorted list is quadratic, so it stops short of the largest size */
+#define BENCH_LIST_MAX 16384
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-t <ms>] [-g <settings>]\n", program_name);
+	fprintf(stderr, "       %s -t 100 -g n=200000,runtime=pareto > bench.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -t  time spent on each priqueue measurement, in milliseconds (default: 20)\n");
+	fprintf(stderr, "  -g  settings of the synthetic trace the schedulers run, as for tracegen (default: n=100000)\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Build with optimization to measure it, eg. make bench CFLAGS=\"-Wall -O2\"\n");
+}
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void print_row(const char *suite, const char *subject, const char *variant, int size, const char *op,
+		unsigned long ops, double seconds)
+{
+	printf("%s,%s,%s,%d,%s,%lu,%.2f,%.0f\n", suite, subject, variant, size, op, ops,
+			seconds * 1e9 / ops, ops / seconds);
+	fflush(stdout);
+}
+
+
+/*
+ * xorshift64: fast and good enough to shuffle benchmark inputs.
+ */
+static unsigned long long rng_state = 0x2545F4914F6CDD1DULL;
+
+static unsigned int next_random()
+{
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return (unsigned int)(rng_state >> 32);
+}
+
+
+int compare_ascending(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+int compare_descending(const void *a, const void *b)
+{
+	return *(const int *)b - *(const int *)a;
+}
+
+int compare_equal(const void *a, const void *b)
+{
+	(void)a;
+	(void)b;
+	return 0;
+}
+
+int key_ascending(const void *a)
+{
+	return *(const int *)a / (BENCH_VALUES / BENCH_LEVELS);
+}
+
+int key_descending(const void *a)
+{
+	return BENCH_LEVELS - 1 - *(const int *)a / (BENCH_VALUES / BENCH_LEVELS);
+}
+
+/*
+ * A queue configuration under test.
+ */
+typedef struct _bench_queue_t
+{
+	const char *backend;
+	const char *comparer;
+	priqueue_backend_t type;
+	int arity;
+	int (*compare)(const void *, const void *);
+	int (*key)(const void *);
+} bench_queue_t;
+
+static const bench_queue_t queues[] =
+{
+	{"list",   "asc",   PRIQUEUE_LIST,   0, compare_ascending,  NULL},
+	{"list",   "desc",  PRIQUEUE_LIST,   0, compare_descending, NULL},
+	{"list",   "equal", PRIQUEUE_LIST,   0, compare_equal,      NULL},
+	{"heap2",  "asc",   PRIQUEUE_HEAP,   2, compare_ascending,  NULL},
+	{"heap2",  "desc",  PRIQUEUE_HEAP,   2, compare_descending, NULL},
+	{"heap2",  "equal", PRIQUEUE_HEAP,   2, compare_equal,      NULL},
+	{"heap4",  "asc",   PRIQUEUE_HEAP,   4, compare_ascending,  NULL},
+	{"heap4",  "desc",  PRIQUEUE_HEAP,   4, compare_descending, NULL},
+	{"heap4",  "equal", PRIQUEUE_HEAP,   4, compare_equal,      NULL},
+	{"bucket", "asc",   PRIQUEUE_BUCKET, 0, compare_ascending,  key_ascending},
+	{"bucket", "desc",  PRIQUEUE_BUCKET, 0, compare_descending, key_descending},
+	{"fifo",   "none",  PRIQUEUE_FIFO,   0, NULL,               NULL},
+};
+
+void bench_queue_init(priqueue_t *q, const bench_queue_t *config)
+{
+	if (config->type == PRIQUEUE_HEAP)
+		priqueue_init_heap(q, config->compare, config->arity);
+	else if (config->type == PRIQUEUE_BUCKET)
+		priqueue_init_buckets(q, config->compare, config->key, BENCH_LEVELS);
+	else if (config->type == PRIQUEUE_FIFO)
+		priqueue_init_fifo(q);
+	else
+		priqueue_init(q, config->compare);
+}
+
+/*
+ * Times one operation on a queue of size elements. Each round times up to BENCH_BATCH operations
+ * and then, untimed, puts the queue back to the elements it held before; rounds repeat until
+ * min_time has passed in all, so operations that are expensive to undo are timed fewer times.
+ * members[0..size) are the pointers in the queue and members[size..size + BENCH_BATCH) spare
+ * ones to offer.
+ */
+void bench_op(priqueue_t *q, const bench_queue_t *config, int size, const char *op, int **members, double min_time)
+{
+	int batch = size < BENCH_BATCH ? size : BENCH_BATCH;
+	unsigned long ops = 0;
+	double elapsed = 0, began = now();
+	void *volatile sink;
+	int i;
+
+	while (ops == 0 || now() - began < min_time)
+	{
+		double start = now();
+
+		if (op[0] == 'o')        // offer
+		{
+			for (i = 0; i < batch; i++)
+				priqueue_offer(q, members[size + i]);
+			elapsed += now() - start;
+
+			for (i = 0; i < batch; i++)
+				priqueue_remove(q, members[size + i]);
+		}
+		else if (op[0] == 'p')   // poll
+		{
+			for (i = 0; i < batch; i++)
+				members[size + i] = priqueue_poll(q);
+			elapsed += now() - start;
+
+			for (i = 0; i < batch; i++)
+				priqueue_offer(q, members[size + i]);
+		}
+		else if (op[0] == 'r')   // remove, of elements chosen at random beforehand
+		{
+			// Move batch random members to the end of members[0..size) and remove those
+			for (i = 0; i < batch; i++)
+			{
+				int pick = next_random() % (size - i);
+				int *swap = members[pick];
+				members[pick] = members[size - 1 - i];
+				members[size - 1 - i] = swap;
+			}
+
+			start = now();
+			for (i = 0; i < batch; i++)
+				priqueue_remove(q, members[size - 1 - i]);
+			elapsed += now() - start;
+
+			for (i = 0; i < batch; i++)
+				priqueue_offer(q, members[size - 1 - i]);
+		}
+		else                     // at, of random indices
+		{
+			int index[BENCH_BATCH];
+			for (i = 0; i < batch; i++)
+				index[i] = next_random() % size;
+
+			start = now();
+			for (i = 0; i < batch; i++)
+				sink = priqueue_at(q, index[i]);
+			elapsed += now() - start;
+		}
+
+		ops += batch;
+	}
+
+	(void)sink;
+	print_row("priqueue", config->backend, config->comparer, size, op, ops, elapsed);
+}
+
+void bench_priqueue(double min_time)
+{
+	static const char *ops[] = {"offer", "poll", "remove", "at"};
+	int max_size = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	int *values = malloc((max_size + BENCH_BATCH) * sizeof(int));
+	int **members = malloc((max_size + BENCH_BATCH) * sizeof(int *));
+	unsigned int c, s, o;
+	int i;
+
+	for (c = 0; c < sizeof(queues) / sizeof(queues[0]); c++)
+	{
+		for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+		{
+			int size = sizes[s];
+			if (queues[c].type == PRIQUEUE_LIST && size > BENCH_LIST_MAX)
+				continue;
+
+			for (i = 0; i < size + BENCH_BATCH; i++)
+			{
+				values[i] = next_random() % BENCH_VALUES;
+				members[i] = &values[i];
+			}
+
+			priqueue_t q;
+			bench_queue_init(&q, &queues[c]);
+			for (i = 0; i < size; i++)
+				priqueue_offer(&q, members[i]);
+
+			for (o = 0; o < sizeof(ops) / sizeof(ops[0]); o++)
+				bench_op(&q, &queues[c], size, ops[o], members, min_time);
+
+			priqueue_destroy(&q);
+		}
+	}
+
+	free(values);
+	free(members);
+}
+
+
+/*
+ * Replays a trace on a scheduler instance, jumping from event to event, and returns the time spent
+ * or -1 if the scheduler lost track of a job or ran out of memory. Finishes are handled before quantum expirations and
+ * those before arrivals, as the simulator does. *decisions counts the scheduler calls made.
+ */
+double bench_replay(const simulator_trace_t *trace, const simulator_config_t *config, unsigned long *decisions)
+{
+	int num_jobs = trace->num_jobs, cores = config->cores;
+	int sliced = simulator_has_quantum(config->scheme);
+	int *remaining = malloc(num_jobs * sizeof(int));
+	int *core_job = malloc(cores * sizeof(int));
+	int *since = malloc(cores * sizeof(int));
+	int *slice = malloc(cores * sizeof(int));
+	int next = 0, done = 0, c, i;
+
+	for (i = 0; i < num_jobs; i++)
+		remaining[i] = trace->jobs[i].run_time;
+	for (c = 0; c < cores; c++)
+		core_job[c] = -1;
+	*decisions = 0;
+
+	double start = now();
+	scheduler_t *sch = simulator_create_scheduler(config);
+	if (sch == NULL)
+	{
+		free(remaining);
+		free(core_job);
+		free(since);
+		free(slice);
+		return -1;
+	}
+
+	while (done < num_jobs)
+	{
+		// The next event: an arrival, a finish or an expired quantum
+		long time = next < num_jobs ? trace->jobs[next].arrival_time : LONG_MAX;
+		for (c = 0; c < cores; c++)
+		{
+			if (core_job[c] == -1)
+				continue;
+
+			long end = since[c] + (long)remaining[core_job[c]];
+			if (sliced && since[c] + slice[c] < end)
+				end = since[c] + slice[c];
+			if (end < time)
+				time = end;
+		}
+
+		if (time == LONG_MAX)
+			break;
+
+		for (c = 0; c < cores; c++)
+		{
+			int job = core_job[c];
+			if (job == -1)
+				continue;
+
+			int ran = time - since[c];
+			if (ran == remaining[job])
+			{
+				remaining[job] = 0;
+				done++;
+				core_job[c] = sched_job_finished(sch, c, job, time);
+			}
+			else if (sliced && ran == slice[c])
+			{
+				remaining[job] -= ran;
+				core_job[c] = sched_quantum_expired(sch, c, time);
+			}
+			else
+				continue;
+
+			since[c] = time;
+			slice[c] = simulator_time_slice(sch, config, c);
+			(*decisions)++;
+		}
+
+		while (next < num_jobs && trace->jobs[next].arrival_time == time)
+		{
+			c = sched_new_job(sch, next, time, trace->jobs[next].run_time, trace->jobs[next].priority);
+			(*decisions)++;
+
+			if (c == SCHEDULER_NO_MEMORY)
+				goto stop;
+			if (c != -1)
+			{
+				// A job already on the core was preempted
+				if (core_job[c] != -1)
+					remaining[core_job[c]] -= time - since[c];
+				core_job[c] = next;
+				since[c] = time;
+				slice[c] = simulator_time_slice(sch, config, c);
+			}
+			next++;
+		}
+	}
+
+stop:
+	sched_destroy(sch);
+	double elapsed = now() - start;
+
+	free(remaining);
+	free(core_job);
+	free(since);
+	free(slice);
+
+	return done == num_jobs ? elapsed : -1;
+}
+
+int bench_scheduler(const simulator_trace_t *trace)
+{
+	static const char *schemes[] = {"fcfs", "sjf", "psjf", "pri", "ppri", "rr4", "mlfq3", "cfs"};
+	static const int core_counts[] = {1, 4};
+	unsigned int s, c;
+	queue_mode_t mode;
+
+	for (s = 0; s < sizeof(schemes) / sizeof(schemes[0]); s++)
+	{
+		simulator_config_t config;
+		config.quantum = 0;
+		simulator_parse_scheme(schemes[s], &config.scheme, &config.quantum, &config.levels);
+
+		for (c = 0; c < sizeof(core_counts) / sizeof(core_counts[0]); c++)
+		{
+			// Per-core run queues only differ from the global queue with more than one core
+			for (mode = QUEUE_GLOBAL; mode <= (core_counts[c] > 1 ? QUEUE_STEAL_TAIL_HALF : QUEUE_GLOBAL); mode++)
+			{
+				unsigned long decisions;
+				config.cores = core_counts[c];
+				config.queues = mode;
+				double elapsed = bench_replay(trace, &config, &decisions);
+
+				if (elapsed < 0)
+				{
+					fprintf(stderr, "The %s scheduler did not finish every job or ran out of memory.\n", schemes[s]);
+					return 3;
+				}
+				print_row("scheduler", schemes[s], simulator_queues_name(mode), core_counts[c], "decision",
+						decisions, elapsed);
+			}
+		}
+	}
+
+	return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+	int c;
+	double min_time = 0.02;
+	tracegen_config_t generator;
+
+	tracegen_defaults(&generator);
+	generator.num_jobs = 100000;
+
+	while ((c = getopt(argc, argv, "t:g:")) != -1)
+	{
+		switch (c)
+		{
+			case 't':
+				min_time = atoi(optarg) / 1e3;
+
+				if (min_time <= 0)
+				{
+					fprintf(stderr, "Option -t <ms> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'g':
+				if (tracegen_parse_spec(optarg, &generator) != 0)
+				{
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	simulator_trace_t trace;
+	tracegen_t gen;
+	tracegen_init(&gen, &generator);
+	int status = simulator_generate_trace(&gen, &trace);
+	if (status != 0)
+		return status;
+
+	printf("suite,subject,variant,size,op,ops,ns_per_op,ops_per_sec\n");
+	bench_priqueue(min_time);
+	status = bench_scheduler(&trace);
+
+	simulator_free_trace(&trace);
+	return status;
+}
@@ -0,0 +1,145 @@
+/** @file libhistogram.c
+ */
+
+#include <string.h>
+
+#include "libhistogram.h"
+
+#define HISTOGRAM_SUB_COUNT (1LL << HISTOGRAM_SUB_BITS)
+
+
+/*
+  Bucket helpers. Values below 2 * HISTOGRAM_SUB_COUNT are their own bucket.
+  Above that, a value whose top bit is bit b is shifted right by
+  b - HISTOGRAM_SUB_BITS, which keeps its HISTOGRAM_SUB_BITS + 1 leading
+  bits, and every shift gets its own run of HISTOGRAM_SUB_COUNT buckets.
+*/
+static int bucket_index(long long value)
+{
+	if(value < 2 * HISTOGRAM_SUB_COUNT)
+	{
+		return (int)value;
+	}
+
+	int shift = 63 - __builtin_clzll(value) - HISTOGRAM_SUB_BITS;
+	return (shift << HISTOGRAM_SUB_BITS) + (int)(value >> shift);
+}
+
+/*
+  Returns the largest value that falls in bucket index.
+*/
+static long long bucket_highest(int index)
+{
+	if(index < 2 * HISTOGRAM_SUB_COUNT)
+	{
+		return index;
+	}
+
+	int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+	long long leading = HISTOGRAM_SUB_COUNT + (index & (HISTOGRAM_SUB_COUNT - 1));
+	return (((leading + 1) << shift) - 1);
+}
+
+
+/**
+  Initializes an empty histogram.
+
+  @param h a pointer to the histogram
+ */
+void histogram_init(histogram_t *h)
+{
+	h->count = 0;
+	h->sum = 0;
+	h->min = 0;
+	h->max = 0;
+	memset(h->counts, 0, sizeof(h->counts));
+}
+
+
+/**
+  Records one value. Negative values are recorded as 0.
+
+  @param h a pointer to the histogram
+  @param value the value to record
+ */
+void histogram_record(histogram_t *h, long long value)
+{
+	if(value < 0)
+	{
+		value = 0;
+	}
+
+	if(h->count == 0 || value < h->min)
+	{
+		h->min = value;
+	}
+	if(h->count == 0 || value > h->max)
+	{
+		h->max = value;
+	}
+	h->count++;
+	h->sum += value;
+	h->counts[bucket_index(value)]++;
+}
+
+
+/**
+  Returns the exact mean of the recorded values.
+
+  @param h a pointer to the histogram
+  @return the mean, or 0 if nothing was recorded
+ */
+double histogram_mean(const histogram_t *h)
+{
+	if(h->count == 0)
+	{
+		return 0.0;
+	}
+	return (double)h->sum / h->count;
+}
+
+
+/**
+  Returns the smallest recorded value that at least percentile percent of
+  the values are less than or equal to, to within the precision of its
+  bucket. 100 returns the exact maximum.
+
+  @param h a pointer to the histogram
+  @param percentile the percentile, from 0 to 100
+  @return the value, or 0 if nothing was recorded
+ */
+long long histogram_percentile(const histogram_t *h, double percentile)
+{
+	if(h->count == 0)
+	{
+		return 0;
+	}
+
+	// Nearest rank: the ceiling of percentile% of the count
+	double exact = percentile / 100.0 * h->count;
+	unsigned long long rank = (unsigned long long)exact;
+	if(rank < exact)
+	{
+		rank++;
+	}
+	if(rank < 1)
+	{
+		rank = 1;
+	}
+	if(rank >= h->count)
+	{
+		return h->max;
+	}
+
+	unsigned long long seen = 0;
+	for(int i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		if(seen >= rank)
+		{
+			long long value = bucket_highest(i);
+			return value < h->max ? value : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,41 @@
+/** @file libhistogram.h
+ */
+
+#ifndef LIBHISTOGRAM_H_
+#define LIBHISTOGRAM_H_
+
+/**
+  Values below 2^(HISTOGRAM_SUB_BITS + 1) are counted exactly. Larger values
+  share a bucket with others within 1/2^HISTOGRAM_SUB_BITS of them, so
+  percentiles are accurate to better than 1%.
+*/
+#define HISTOGRAM_SUB_BITS 7
+
+/**
+  Number of buckets needed to cover every non-negative long long.
+*/
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS) << HISTOGRAM_SUB_BITS)
+
+/**
+  Log-linear (HDR-style) histogram
+
+  Each power of two is split into 2^HISTOGRAM_SUB_BITS equal buckets, so the
+  memory used is fixed however many values are recorded and however large
+  they are. The sum, minimum and maximum are kept exactly, the sum in 64
+  bits.
+*/
+typedef struct _histogram_t
+{
+	unsigned long long count;
+	unsigned long long sum;
+	long long min;
+	long long max;
+	unsigned long long counts[HISTOGRAM_BUCKETS];
+} histogram_t;
+
+void      histogram_init      (histogram_t *h);
+void      histogram_record    (histogram_t *h, long long value);
+double    histogram_mean      (const histogram_t *h);
+long long histogram_percentile(const histogram_t *h, double percentile);
+
+#endif /* LIBHISTOGRAM_H_ */
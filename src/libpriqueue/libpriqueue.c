@@ -1,11 +1,578 @@
 /** @file libpriqueue.c
  */
 
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "libpriqueue.h"
 
+#define PRIQUEUE_MIN_CAPACITY 16
+#define PRIQUEUE_OVERFLOW_ARITY 4
+#define BITMAP_WORD_BITS 64
+
+
+/*
+  Every comparer call goes through here so it can be counted when
+  PRIQUEUE_STATS is on.
+*/
+static inline int call_comparer(priqueue_t *q, const void *a, const void *b)
+{
+#if PRIQUEUE_STATS
+	q->comparisons++;
+#endif
+	return q->comparer(a, b);
+}
+
+/*
+  List node allocator. Nodes come from slabs owned by the queue and go back
+  on its free list when they leave the queue.
+*/
+static p_node_t *node_alloc(priqueue_t *q)
+{
+	if(q->free_nodes == NULL)
+	{
+		p_slab_t *slab = malloc(sizeof(p_slab_t));
+		if(slab == NULL)
+		{
+			return NULL;
+		}
+		q->allocations++;
+
+		slab->next = q->slabs;
+		q->slabs = slab;
+		for(int i = PRIQUEUE_SLAB_NODES - 1; i >= 0; i--)
+		{
+			slab->nodes[i].next = q->free_nodes;
+			q->free_nodes = &slab->nodes[i];
+		}
+	}
+
+	p_node_t *node = q->free_nodes;
+	q->free_nodes = node->next;
+	return node;
+}
+
+static void node_free(priqueue_t *q, p_node_t *node)
+{
+	node->next = q->free_nodes;
+	q->free_nodes = node;
+}
+
+
+/*
+  Heap helpers. Entries are ordered by the comparer first and by the order
+  they were offered in second, which reproduces the stable ordering of the
+  sorted list.
+*/
+static int heap_less(priqueue_t *q, const p_entry_t *a, const p_entry_t *b)
+{
+	int compare = call_comparer(q, a->job, b->job);
+
+	if(compare != 0)
+	{
+		return compare < 0;
+	}
+	return a->seq < b->seq;
+}
+
+static int heap_order_compare(const void *a, const void *b, void *arg)
+{
+	priqueue_t *q = arg;
+
+	if(heap_less(q, a, b))
+	{
+		return -1;
+	}
+	return heap_less(q, b, a);
+}
+
+static void heap_place(priqueue_t *q, int index, p_entry_t entry)
+{
+	q->heap[index] = entry;
+	q->positions[entry.handle] = index;
+}
+
+static int heap_sift_up(priqueue_t *q, int index)
+{
+	p_entry_t entry = q->heap[index];
+
+	while(index > 0)
+	{
+		int parent = (index - 1) / q->arity;
+		if(!heap_less(q, &entry, &q->heap[parent]))
+		{
+			break;
+		}
+		heap_place(q, index, q->heap[parent]);
+		index = parent;
+	}
+	heap_place(q, index, entry);
+	return index;
+}
+
+static void heap_sift_down(priqueue_t *q, int index)
+{
+	p_entry_t entry = q->heap[index];
+
+	while(1)
+	{
+		int first = index * q->arity + 1;
+		if(first >= q->size)
+		{
+			break;
+		}
+
+		int last = first + q->arity;
+		if(last > q->size)
+		{
+			last = q->size;
+		}
+
+		int best = first;
+		for(int i = first + 1; i < last; i++)
+		{
+			if(heap_less(q, &q->heap[i], &q->heap[best]))
+			{
+				best = i;
+			}
+		}
+
+		if(!heap_less(q, &q->heap[best], &entry))
+		{
+			break;
+		}
+		heap_place(q, index, q->heap[best]);
+		index = best;
+	}
+	heap_place(q, index, entry);
+}
+
+static void heap_fix(priqueue_t *q, int index)
+{
+	if(heap_sift_up(q, index) == index)
+	{
+		heap_sift_down(q, index);
+	}
+}
+
+static void heap_delete(priqueue_t *q, int index)
+{
+	q->free_handles[q->free_count++] = q->heap[index].handle;
+	q->positions[q->heap[index].handle] = -1;
+
+	q->size--;
+	q->order_valid = 0;
+	if(index == q->size)
+	{
+		return;
+	}
+
+	q->heap[index] = q->heap[q->size];
+	heap_fix(q, index);
+}
+
+static void heap_build_order(priqueue_t *q)
+{
+	if(q->order_valid)
+	{
+		return;
+	}
+
+	for(int i = 0; i < q->size; i++)
+	{
+		q->order[i] = q->heap[i];
+	}
+	qsort_r(q->order, q->size, sizeof(p_entry_t), heap_order_compare, q);
+	q->order_valid = 1;
+}
+
+static int heap_grow(priqueue_t *q)
+{
+	int capacity = q->capacity * 2;
+	p_entry_t *heap = realloc(q->heap, capacity * sizeof(p_entry_t));
+	if(heap == NULL)
+	{
+		return -1;
+	}
+	q->heap = heap;
+
+	p_entry_t *order = realloc(q->order, capacity * sizeof(p_entry_t));
+	if(order == NULL)
+	{
+		return -1;
+	}
+	q->order = order;
+
+	int *positions = realloc(q->positions, capacity * sizeof(int));
+	if(positions == NULL)
+	{
+		return -1;
+	}
+	q->positions = positions;
+
+	int *free_handles = realloc(q->free_handles, capacity * sizeof(int));
+	if(free_handles == NULL)
+	{
+		return -1;
+	}
+	q->free_handles = free_handles;
+
+	/* Hand out the new handles lowest first */
+	for(int h = capacity - 1; h >= q->capacity; h--)
+	{
+		q->positions[h] = -1;
+		q->free_handles[q->free_count++] = h;
+	}
+
+	q->allocations += 4;
+	q->capacity = capacity;
+	return 0;
+}
+
+static int heap_insert(priqueue_t *q, void *ptr, int *index)
+{
+	if(q->size == q->capacity && heap_grow(q) < 0)
+	{
+		return -1;
+	}
+
+	p_entry_t entry;
+	entry.job = ptr;
+	entry.seq = q->seq++;
+	entry.handle = q->free_handles[--q->free_count];
+
+	q->heap[q->size] = entry;
+	q->size++;
+	q->order_valid = 0;
+
+	*index = heap_sift_up(q, q->size - 1);
+	return entry.handle;
+}
+
+static int heap_offer(priqueue_t *q, void *ptr)
+{
+	int index;
+
+	if(heap_insert(q, ptr, &index) < 0)
+	{
+		return -1;
+	}
+	return index;
+}
+
+static void *heap_poll(priqueue_t *q)
+{
+	void *job = q->heap[0].job;
+
+	heap_delete(q, 0);
+	return job;
+}
+
+static int heap_remove(priqueue_t *q, void *ptr)
+{
+	int kept = 0;
+
+	for(int i = 0; i < q->size; i++)
+	{
+		if(q->heap[i].job != ptr)
+		{
+			heap_place(q, kept++, q->heap[i]);
+		}
+		else
+		{
+			q->free_handles[q->free_count++] = q->heap[i].handle;
+			q->positions[q->heap[i].handle] = -1;
+		}
+	}
+
+	int removals = q->size - kept;
+	if(removals > 0)
+	{
+		/* Rebuild the heap bottom-up over the surviving entries */
+		q->size = kept;
+		q->order_valid = 0;
+		for(int i = (kept - 2) / q->arity; kept > 1 && i >= 0; i--)
+		{
+			heap_sift_down(q, i);
+		}
+	}
+	return removals;
+}
+
+static void *heap_remove_at(priqueue_t *q, int index)
+{
+	heap_build_order(q);
+
+	void *job = q->order[index].job;
+	heap_delete(q, q->positions[q->order[index].handle]);
+
+	// The entries before the last one are still in order, so taking elements from the back stays cheap
+	if(index == q->size)
+	{
+		q->order_valid = 1;
+	}
+	return job;
+}
+
+/*
+  Ring buffer helpers for FIFO queues. Slots are addressed relative to the
+  head so index 0 is always the front of the queue.
+*/
+static void **fifo_slot(priqueue_t *q, int index)
+{
+	return &q->ring[(q->head + index) & (q->capacity - 1)];
+}
+
+static int fifo_offer(priqueue_t *q, void *ptr)
+{
+	if(q->size == q->capacity)
+	{
+		int capacity = q->capacity * 2;
+		void **ring = malloc(capacity * sizeof(void *));
+
+		if(ring == NULL)
+		{
+			return -1;
+		}
+		for(int i = 0; i < q->size; i++)
+		{
+			ring[i] = *fifo_slot(q, i);
+		}
+		free(q->ring);
+		q->allocations++;
+		q->ring = ring;
+		q->head = 0;
+		q->capacity = capacity;
+	}
+
+	*fifo_slot(q, q->size) = ptr;
+	return q->size++;
+}
+
+static void *fifo_poll(priqueue_t *q)
+{
+	void *job = q->ring[q->head];
+
+	q->head = (q->head + 1) & (q->capacity - 1);
+	q->size--;
+	return job;
+}
+
+static int fifo_remove(priqueue_t *q, void *ptr)
+{
+	int kept = 0;
+
+	for(int i = 0; i < q->size; i++)
+	{
+		void *job = *fifo_slot(q, i);
+		if(job != ptr)
+		{
+			*fifo_slot(q, kept++) = job;
+		}
+	}
+
+	int removals = q->size - kept;
+	q->size = kept;
+	return removals;
+}
+
+/*
+  Closes the gap from whichever end is nearer, so taking the front (as a
+  bucket queue does on every poll) is O(1) like fifo_poll().
+*/
+static void *fifo_remove_at(priqueue_t *q, int index)
+{
+	void *job = *fifo_slot(q, index);
+
+	if(index < q->size / 2)
+	{
+		for(int i = index; i > 0; i--)
+		{
+			*fifo_slot(q, i) = *fifo_slot(q, i - 1);
+		}
+		q->head = (q->head + 1) & (q->capacity - 1);
+	}
+	else
+	{
+		for(int i = index + 1; i < q->size; i++)
+		{
+			*fifo_slot(q, i - 1) = *fifo_slot(q, i);
+		}
+	}
+	q->size--;
+	return job;
+}
+
+/*
+  Bucket queue helpers. Each in-range key owns a FIFO kept sorted by the
+  comparer, so elements that arrive in order are appended in O(1) and only
+  late arrivals (e.g. preempted jobs) walk back past the elements they
+  precede. Non-empty levels are found with find-first-set on the bitmap.
+*/
+static void bucket_update_bit(priqueue_t *q, int level)
+{
+	unsigned long long bit = 1ULL << (level % BITMAP_WORD_BITS);
+
+	if(q->buckets[level].size > 0)
+	{
+		q->bitmap[level / BITMAP_WORD_BITS] |= bit;
+	}
+	else
+	{
+		q->bitmap[level / BITMAP_WORD_BITS] &= ~bit;
+	}
+}
+
+static int bucket_first(priqueue_t *q)
+{
+	int words = (q->levels + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+	for(int w = 0; w < words; w++)
+	{
+		if(q->bitmap[w] != 0)
+		{
+			return w * BITMAP_WORD_BITS + __builtin_ctzll(q->bitmap[w]);
+		}
+	}
+	return -1;
+}
+
+static int bucket_next_level(priqueue_t *q, int level)
+{
+	int words = (q->levels + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+
+	for(int w = level / BITMAP_WORD_BITS; level < q->levels && w < words; w++)
+	{
+		unsigned long long bits = q->bitmap[w];
+		if(w == level / BITMAP_WORD_BITS)
+		{
+			bits &= ~0ULL << (level % BITMAP_WORD_BITS);
+		}
+		if(bits != 0)
+		{
+			return w * BITMAP_WORD_BITS + __builtin_ctzll(bits);
+		}
+	}
+	return -1;
+}
+
+static int bucket_offer(priqueue_t *q, void *ptr)
+{
+	int level = q->key(ptr);
+
+	if(level < 0 || level >= q->levels)
+	{
+		int index = priqueue_offer(q->overflow, ptr);
+		if(index >= 0)
+		{
+			q->size++;
+		}
+		return index;
+	}
+
+	priqueue_t *b = &q->buckets[level];
+	int index = fifo_offer(b, ptr);
+	if(index < 0)
+	{
+		return -1;
+	}
+
+	while(index > 0 && call_comparer(q, *fifo_slot(b, index - 1), ptr) > 0)
+	{
+		*fifo_slot(b, index) = *fifo_slot(b, index - 1);
+		index--;
+	}
+	*fifo_slot(b, index) = ptr;
+
+	bucket_update_bit(q, level);
+	q->size++;
+
+	for(int i = 0; i < level; i++)
+	{
+		index += q->buckets[i].size;
+	}
+	return index;
+}
+
+static priqueue_t *bucket_front(priqueue_t *q)
+{
+	int level = bucket_first(q);
+	priqueue_t *best = (level >= 0) ? &q->buckets[level] : NULL;
+
+	if(priqueue_size(q->overflow) > 0 &&
+	   (best == NULL || call_comparer(q, priqueue_peek(q->overflow), priqueue_peek(best)) < 0))
+	{
+		best = q->overflow;
+	}
+	return best;
+}
+
+static void *bucket_take(priqueue_t *q, priqueue_t *from, int index)
+{
+	// Polling the front keeps the overflow heap at O(log n); remove_at would sort it first
+	void *job = (index == 0) ? priqueue_poll(from) : priqueue_remove_at(from, index);
+
+	if(from != q->overflow)
+	{
+		bucket_update_bit(q, from - q->buckets);
+	}
+	q->size--;
+	return job;
+}
+
+/*
+  Finds the queue and position holding the index'th element in comparer
+  order by merging the buckets with the sorted overflow heap. Buckets that
+  lie entirely before the next overflow element are skipped whole.
+*/
+static priqueue_t *bucket_find(priqueue_t *q, int index, int *slot)
+{
+	int words = (q->levels + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS;
+	int o = 0;
+
+	for(int w = 0; w < words; w++)
+	{
+		unsigned long long bits = q->bitmap[w];
+		while(bits != 0)
+		{
+			priqueue_t *b = &q->buckets[w * BITMAP_WORD_BITS + __builtin_ctzll(bits)];
+			bits &= bits - 1;
+
+			void *next = priqueue_at(q->overflow, o);
+			if(index >= b->size && (next == NULL || call_comparer(q, next, *fifo_slot(b, b->size - 1)) >= 0))
+			{
+				index -= b->size;
+				continue;
+			}
+
+			for(int i = 0; i < b->size; i++)
+			{
+				void *job = *fifo_slot(b, i);
+				while((next = priqueue_at(q->overflow, o)) != NULL && call_comparer(q, next, job) < 0)
+				{
+					if(index == 0)
+					{
+						*slot = o;
+						return q->overflow;
+					}
+					index--;
+					o++;
+				}
+				if(index == 0)
+				{
+					*slot = i;
+					return b;
+				}
+				index--;
+			}
+		}
+	}
+
+	*slot = o + index;
+	return q->overflow;
+}
+
 
 /**
   Initializes the priqueue_t data structure.
@@ -21,7 +588,126 @@ void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
 {
 	q->size = 0;
 	q->front = NULL;
+	q->back = NULL;
 	q->comparer = comparer;
+
+	q->backend = PRIQUEUE_LIST;
+	q->slabs = NULL;
+	q->free_nodes = NULL;
+	q->allocations = 0;
+	q->comparisons = 0;
+	q->arity = 0;
+	q->capacity = 0;
+	q->seq = 0;
+	q->heap = NULL;
+	q->order = NULL;
+	q->order_valid = 0;
+	q->positions = NULL;
+	q->free_handles = NULL;
+	q->free_count = 0;
+	q->head = 0;
+	q->ring = NULL;
+	q->levels = 0;
+	q->key = NULL;
+	q->buckets = NULL;
+	q->bitmap = NULL;
+	q->overflow = NULL;
+}
+
+
+/**
+  Initializes the priqueue_t data structure backed by an array-based d-ary
+  heap instead of a sorted list.
+
+  Offer and poll cost O(log n) and elements are stored contiguously. Elements
+  the comparer considers equal are still returned in the order they were
+  offered, so the heap orders elements exactly like priqueue_init() does.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  @param arity the number of children per heap node (2 for a binary heap, 4 for a 4-ary heap, ...)
+  @return 0, or -1 if memory ran out; q must then only be passed to priqueue_destroy()
+  See also @ref comparer-page
+ */
+int priqueue_init_heap(priqueue_t *q, int(*comparer)(const void *, const void *), int arity)
+{
+	priqueue_init(q, comparer);
+
+	q->backend = PRIQUEUE_HEAP;
+	q->arity = (arity < 2) ? 2 : arity;
+	q->capacity = PRIQUEUE_MIN_CAPACITY;
+	q->heap = malloc(q->capacity * sizeof(p_entry_t));
+	q->order = malloc(q->capacity * sizeof(p_entry_t));
+	q->positions = malloc(q->capacity * sizeof(int));
+	q->free_handles = malloc(q->capacity * sizeof(int));
+	q->allocations += 4;
+	if(q->heap == NULL || q->order == NULL || q->positions == NULL || q->free_handles == NULL)
+	{
+		return -1;
+	}
+
+	for(int h = q->capacity - 1; h >= 0; h--)
+	{
+		q->positions[h] = -1;
+		q->free_handles[q->free_count++] = h;
+	}
+	return 0;
+}
+
+
+/**
+  Initializes the priqueue_t data structure as a plain first-in first-out
+  queue backed by a growable ring buffer.
+
+  No comparer is used: elements are returned in the order they were offered.
+  Offer and poll are O(1) and never allocate once the buffer has grown to the
+  largest backlog seen.
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_init_fifo(priqueue_t *q)
+{
+	priqueue_init(q, NULL);
+
+	q->backend = PRIQUEUE_FIFO;
+	q->capacity = PRIQUEUE_MIN_CAPACITY;
+	q->ring = malloc(q->capacity * sizeof(void *));
+	q->allocations++;
+}
+
+
+/**
+  Initializes the priqueue_t data structure as a bucketed multi-level queue
+  for small integer keys, in the style of an O(1) run queue.
+
+  Every key in [0, levels) owns a FIFO and an occupancy bitmap locates the
+  lowest non-empty level with find-first-set, so offer and poll are O(1) when
+  elements of a level arrive in comparer order. Within a level elements are
+  kept in comparer order, which lets the comparer break ties between equal
+  keys. Elements whose key falls outside the range go to a d-ary heap that
+  is merged with the buckets on poll.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements. It must order elements by key first.
+  @param key a function pointer that returns the integer key of an element
+  @param levels the number of keys, starting at 0, that get their own bucket
+  See also @ref comparer-page
+ */
+void priqueue_init_buckets(priqueue_t *q, int(*comparer)(const void *, const void *), int(*key)(const void *), int levels)
+{
+	priqueue_init(q, comparer);
+
+	q->backend = PRIQUEUE_BUCKET;
+	q->levels = (levels < 1) ? 1 : levels;
+	q->key = key;
+
+	q->buckets = malloc(q->levels * sizeof(priqueue_t));
+	for(int i = 0; i < q->levels; i++)
+	{
+		priqueue_init_fifo(&q->buckets[i]);
+	}
+	q->bitmap = calloc((q->levels + BITMAP_WORD_BITS - 1) / BITMAP_WORD_BITS, sizeof(unsigned long long));
+
+	q->overflow = malloc(sizeof(priqueue_t));
+	priqueue_init_heap(q->overflow, comparer, PRIQUEUE_OVERFLOW_ARITY);
+	q->allocations += 3;
 }
 
 
@@ -31,10 +717,28 @@ void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
   @param q a pointer to an instance of the priqueue_t data structure
   @param ptr a pointer to the data to be inserted into the priority queue
   @return The zero-based index where ptr is stored in the priority queue, where 0 indicates that ptr was stored at the front of the priority queue.
+  For heap backed queues this is the slot in the heap array; 0 still means ptr is now at the front.
  */
 int priqueue_offer(priqueue_t *q, void *ptr)
 {
-	p_node_t *node = malloc (sizeof(p_node_t));
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		return heap_offer(q, ptr);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return fifo_offer(q, ptr);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		return bucket_offer(q, ptr);
+	}
+
+	p_node_t *node = node_alloc(q);
+	if(node == NULL)
+	{
+		return -1;
+	}
 	node->job = ptr;
 	node->next = NULL;
 	int index = 0;
@@ -51,7 +755,7 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 	else if(priqueue_size(q) == 1)
 	{
 		//check the existing node for priority. If input node is higher, swap.
-		if(q->comparer(node->job, q->front->job) < 0)
+		if(call_comparer(q, node->job, q->front->job) < 0)
 		{
 			node->next = q->front;
 			q->front = node;
@@ -75,7 +779,7 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 		while(temp != NULL)
 		{
 			//compare for higher priority
-			if(q->comparer((ptr), (temp->job)) < 0)
+			if(call_comparer(q, (ptr), (temp->job)) < 0)
 			{
 				//if at the front of the queue
 				if(temp == q->front)
@@ -101,14 +805,99 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 		if(temp == NULL)
 		{
 			temp2 -> next = node;
+			q->back = node;
 			q->size++;
-			index++;
 		}
 		return index;
 	}
 }
 
 
+/**
+  Inserts the specified element into a heap backed priority queue and
+  returns a handle that refers to it for as long as it stays queued.
+
+  Handles stay valid while the heap reorders itself and are only recycled
+  once their element leaves the queue.
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a non-negative handle for ptr
+  @return -1 if q is not heap backed or memory ran out
+ */
+int priqueue_offer_handle(priqueue_t *q, void *ptr)
+{
+	int index;
+
+	if(q->backend != PRIQUEUE_HEAP)
+	{
+		return -1;
+	}
+	return heap_insert(q, ptr, &index);
+}
+
+
+/**
+  Returns the element a handle refers to without removing it.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+  @return the element the handle refers to
+  @return NULL if the handle does not refer to a queued element
+ */
+void *priqueue_handle_get(priqueue_t *q, int handle)
+{
+	if(q->backend != PRIQUEUE_HEAP || handle < 0 || handle >= q->capacity || q->positions[handle] < 0)
+	{
+		return NULL;
+	}
+	return q->heap[q->positions[handle]].job;
+}
+
+
+/**
+  Restores the ordering of an element whose key changed while it was queued,
+  e.g. a job whose remaining time or priority was adjusted in place. This
+  costs O(log n) instead of a remove and re-offer.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+  @return the new position of the element in the heap array
+  @return -1 if the handle does not refer to a queued element
+ */
+int priqueue_update_key(priqueue_t *q, int handle)
+{
+	if(priqueue_handle_get(q, handle) == NULL)
+	{
+		return -1;
+	}
+
+	int index = q->positions[handle];
+	q->order_valid = 0;
+	heap_fix(q, index);
+	return q->positions[handle];
+}
+
+
+/**
+  Removes the element a handle refers to in O(log n).
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+  @return the element removed from the queue
+  @return NULL if the handle does not refer to a queued element
+ */
+void *priqueue_remove_handle(priqueue_t *q, int handle)
+{
+	void *job = priqueue_handle_get(q, handle);
+
+	if(job != NULL)
+	{
+		heap_delete(q, q->positions[handle]);
+	}
+	return job;
+}
+
+
 /**
   Retrieves, but does not remove, the head of this queue, returning NULL if
   this queue is empty.
@@ -123,9 +912,21 @@ void *priqueue_peek(priqueue_t *q)
 	{
 		return NULL;
 	}
+	else if(q->backend == PRIQUEUE_HEAP)
+	{
+		return (q->heap[0].job);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return (q->ring[q->head]);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		return priqueue_peek(bucket_front(q));
+	}
 	else
 	{
-		return (q->front);
+		return (q->front->job);
 	}
 }
 
@@ -144,12 +945,28 @@ void *priqueue_poll(priqueue_t *q)
 	{
 		return NULL;
 	}
+	else if(q->backend == PRIQUEUE_HEAP)
+	{
+		return heap_poll(q);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return fifo_poll(q);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		return bucket_take(q, bucket_front(q), 0);
+	}
 	else
 	{
 		p_node_t *temp = q->front;
 		q->front = q->front->next;
+		if(q->front == NULL)
+		{
+			q->back = NULL;
+		}
 		void *tempval = temp->job;
-		free(temp);
+		node_free(q, temp);
 		q->size--;
 		return (tempval);
 	}
@@ -160,6 +977,9 @@ void *priqueue_poll(priqueue_t *q)
   Returns the element at the specified position in this list, or NULL if
   the queue does not contain an index'th element.
 
+  Heap backed queues answer from a sorted copy of the heap that is only
+  rebuilt after the queue changes.
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param index position of retrieved element
   @return the index'th element in the queue
@@ -167,11 +987,27 @@ void *priqueue_poll(priqueue_t *q)
  */
 void *priqueue_at(priqueue_t *q, int index)
 {
-  if(index > priqueue_size(q) || index < 0)
+	if(index >= priqueue_size(q) || index < 0)
 	{
 		return NULL;
 	}
 
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		heap_build_order(q);
+		return(q->order[index].job);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return(*fifo_slot(q, index));
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		int slot;
+		priqueue_t *from = bucket_find(q, index, &slot);
+		return priqueue_at(from, slot);
+	}
+
 	if(index == 0)
 	{
 	   return(q->front->job);
@@ -206,30 +1042,60 @@ int priqueue_remove(priqueue_t *q, void *ptr)
 	{
 		return 0;
 	}
+	else if(q->backend == PRIQUEUE_HEAP)
+	{
+		return heap_remove(q, ptr);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return fifo_remove(q, ptr);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		int removals = priqueue_remove(q->overflow, ptr);
+		for(int i = 0; i < q->levels; i++)
+		{
+			if(q->buckets[i].size > 0)
+			{
+				removals += fifo_remove(&q->buckets[i], ptr);
+				bucket_update_bit(q, i);
+			}
+		}
+		q->size -= removals;
+		return removals;
+	}
 	else
 	{
 		int removals = 0;
 		p_node_t *temp = q->front;
-		p_node_t *temp2 = q->front;
+		p_node_t *temp2 = NULL;
 
 		while(temp != NULL)
 		{
+			p_node_t *next = temp->next;
 			if(temp->job == ptr)
 			{
-				if(temp == q->front)
+				if(temp2 == NULL)
 				{
-					q->front = temp2 -> next;
-					temp2 = q->front;
+					q->front = next;
 				}
 				else
 				{
-					temp2 -> next = temp->next;
+					temp2 -> next = next;
 				}
-				free(temp);
+				if(temp == q->back)
+				{
+					q->back = temp2;
+				}
+				node_free(q, temp);
 				q->size--;
 				removals++;
 			}
-			temp = temp->next;
+			else
+			{
+				temp2 = temp;
+			}
+			temp = next;
 		}
 		return (removals);
 	}
@@ -252,46 +1118,52 @@ void *priqueue_remove_at(priqueue_t *q, int index)
 		return NULL;
 	}
 
-	if(priqueue_size(q) == 1)
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		return heap_remove_at(q, index);
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		return fifo_remove_at(q, index);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		int slot;
+		priqueue_t *from = bucket_find(q, index, &slot);
+		return bucket_take(q, from, slot);
+	}
+
+	void *job;
+	p_node_t *temp = q->front;
+	if(index == 0)
 	{
-		free(&q->front);
-		q->front = NULL;
+		q->front = temp->next;
+		if(q->front == NULL)
+		{
+			q->back = NULL;
+		}
+		job = temp->job;
+		node_free(q, temp);
 		q->size--;
 	}
 	else
 	{
-		p_node_t *temp = q->front;
-    if(index == 0)
-    {
-      q->front = temp->next;
-      free(temp);
-      q->size--;
-    }
-    else
-    {
-  		while(index > 1)
-  		{
-  			temp = temp->next;
-  			index--;
-  		}
-			p_node_t *delete = temp->next;
-  		if(delete->next == NULL)
-  		{
-  			q->back = temp;
-  			free(delete);
-        temp->next = NULL;
-  			q->size--;
-  		}
-      else
-      {
-        temp->next = delete->next;
-        free(delete);
-        q->size--;
-      }
-    }
-
+		while(index > 1)
+		{
+			temp = temp->next;
+			index--;
+		}
+		p_node_t *delete = temp->next;
+		temp->next = delete->next;
+		if(delete->next == NULL)
+		{
+			q->back = temp;
+		}
+		job = delete->job;
+		node_free(q, delete);
+		q->size--;
 	}
-	return 0;
+	return job;
 }
 
 
@@ -307,6 +1179,163 @@ int priqueue_size(priqueue_t *q)
 }
 
 
+/**
+  Positions a cursor on the first element of the queue.
+
+  Walking the whole queue with priqueue_iter_next() costs O(n) for list,
+  FIFO and bucket queues. Heap backed queues walk the sorted copy of the heap
+  that priqueue_at() uses, which is only re-sorted after the queue changes,
+  so repeated walks of an unchanged queue are O(n) as well.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param it a pointer to the cursor to initialize
+ */
+void priqueue_iter_begin(priqueue_t *q, priqueue_iter_t *it)
+{
+	it->q = q;
+	it->index = 0;
+	it->node = q->front;
+	it->level = -1;
+	it->slot = 0;
+	it->overflow = 0;
+
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		heap_build_order(q);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		it->level = bucket_next_level(q, 0);
+	}
+}
+
+
+/**
+  Returns the element under the cursor and advances it.
+
+  @param it a pointer to a cursor set up by priqueue_iter_begin()
+  @return the next element in priority order
+  @return NULL once every element has been returned
+ */
+void *priqueue_iter_next(priqueue_iter_t *it)
+{
+	priqueue_t *q = it->q;
+	void *job = NULL;
+
+	if(it->index >= q->size)
+	{
+		return NULL;
+	}
+
+	if(q->backend == PRIQUEUE_HEAP)
+	{
+		job = q->order[it->index].job;
+	}
+	else if(q->backend == PRIQUEUE_FIFO)
+	{
+		job = *fifo_slot(q, it->index);
+	}
+	else if(q->backend == PRIQUEUE_BUCKET)
+	{
+		void *next = priqueue_at(q->overflow, it->overflow);
+		void *bucket = (it->level >= 0) ? *fifo_slot(&q->buckets[it->level], it->slot) : NULL;
+
+		if(bucket == NULL || (next != NULL && call_comparer(q, next, bucket) < 0))
+		{
+			job = next;
+			it->overflow++;
+		}
+		else
+		{
+			job = bucket;
+			if(++it->slot == q->buckets[it->level].size)
+			{
+				it->level = bucket_next_level(q, it->level + 1);
+				it->slot = 0;
+			}
+		}
+	}
+	else
+	{
+		job = it->node->job;
+		it->node = it->node->next;
+	}
+
+	it->index++;
+	return job;
+}
+
+
+/**
+  Copies up to n elements of the queue, in priority order, into buf.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param buf the buffer to fill
+  @param n the number of elements buf can hold
+  @return the number of elements copied
+ */
+int priqueue_snapshot(priqueue_t *q, void **buf, int n)
+{
+	priqueue_iter_t it;
+	int count = 0;
+
+	priqueue_iter_begin(q, &it);
+	while(count < n && count < q->size)
+	{
+		buf[count++] = priqueue_iter_next(&it);
+	}
+	return count;
+}
+
+
+/**
+  Returns the number of times q has called its comparer since it was
+  initialized, including the calls made by the queues a bucket queue is
+  built from. Always 0 when built with PRIQUEUE_STATS set to 0.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @return the number of comparer calls made on behalf of q
+ */
+unsigned long priqueue_comparisons(priqueue_t *q)
+{
+	unsigned long comparisons = q->comparisons;
+
+	if(q->backend == PRIQUEUE_BUCKET)
+	{
+		for(int i = 0; i < q->levels; i++)
+		{
+			comparisons += priqueue_comparisons(&q->buckets[i]);
+		}
+		comparisons += priqueue_comparisons(q->overflow);
+	}
+	return comparisons;
+}
+
+
+/**
+  Returns the number of heap allocations q has made since it was
+  initialized, including growth of its arrays and the queues a bucket queue
+  is built from.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @return the number of calls to malloc/realloc made on behalf of q
+ */
+unsigned long priqueue_allocations(priqueue_t *q)
+{
+	unsigned long allocations = q->allocations;
+
+	if(q->backend == PRIQUEUE_BUCKET)
+	{
+		for(int i = 0; i < q->levels; i++)
+		{
+			allocations += priqueue_allocations(&q->buckets[i]);
+		}
+		allocations += priqueue_allocations(q->overflow);
+	}
+	return allocations;
+}
+
+
 /**
   Destroys and frees all the memory associated with q.
 
@@ -314,11 +1343,41 @@ int priqueue_size(priqueue_t *q)
  */
 void priqueue_destroy(priqueue_t *q)
 {
-	p_node_t * temp = q->front;
-	while(q->front != NULL)
+	while(q->slabs != NULL)
 	{
-		q->front = temp->next;
-		free(temp);
-		temp = q->front;
+		p_slab_t *slab = q->slabs;
+		q->slabs = slab->next;
+		free(slab);
 	}
+	q->front = NULL;
+	q->back = NULL;
+	q->free_nodes = NULL;
+
+	free(q->heap);
+	free(q->order);
+	free(q->positions);
+	free(q->free_handles);
+	free(q->ring);
+	q->heap = NULL;
+	q->order = NULL;
+	q->positions = NULL;
+	q->free_handles = NULL;
+	q->free_count = 0;
+	q->ring = NULL;
+
+	if(q->backend == PRIQUEUE_BUCKET)
+	{
+		for(int i = 0; i < q->levels; i++)
+		{
+			priqueue_destroy(&q->buckets[i]);
+		}
+		priqueue_destroy(q->overflow);
+		free(q->buckets);
+		free(q->bitmap);
+		free(q->overflow);
+		q->buckets = NULL;
+		q->bitmap = NULL;
+		q->overflow = NULL;
+	}
+	q->size = 0;
 }
@@ -4,6 +4,19 @@
 #ifndef LIBPRIQUEUE_H_
 #define LIBPRIQUEUE_H_
 
+/**
+  Set to 0 to compile out the comparer-call counter reported by
+  priqueue_comparisons().
+*/
+#ifndef PRIQUEUE_STATS
+#define PRIQUEUE_STATS 1
+#endif
+
+/**
+  Storage backends that can sit behind the priqueue_t API.
+*/
+typedef enum {PRIQUEUE_LIST = 0, PRIQUEUE_HEAP, PRIQUEUE_FIFO, PRIQUEUE_BUCKET} priqueue_backend_t;
+
 typedef struct p_node_t p_node_t;
 /**
 	Process Nodes
@@ -15,6 +28,39 @@ struct p_node_t
 	//p_node_t *prev;
 };
 
+/**
+  Number of list nodes carved out of each slab.
+*/
+#define PRIQUEUE_SLAB_NODES 64
+
+typedef struct p_slab_t p_slab_t;
+/**
+	Node Slabs
+
+	List nodes are allocated a slab at a time and recycled through a per-queue
+	free list, so steady-state offer/poll cycles never touch the heap.
+*/
+struct p_slab_t
+{
+	p_slab_t *next;
+	p_node_t nodes[PRIQUEUE_SLAB_NODES];
+};
+
+typedef struct p_entry_t p_entry_t;
+/**
+	Heap Entries
+
+	seq records the order elements were offered in so that elements the
+	comparer considers equal leave the heap in FIFO order, exactly as they
+	do from the sorted list.
+*/
+struct p_entry_t
+{
+	void *job;
+	unsigned long seq;
+	int handle;
+};
+
 /**
   Priqueue Data Structure
 */
@@ -24,13 +70,76 @@ typedef struct _priqueue_t
 	p_node_t *front;
 	int (*comparer) (const void*, const void *);
 	p_node_t *back;
+
+	priqueue_backend_t backend;
+
+	/* PRIQUEUE_LIST: node slabs and the free list threaded through them */
+	p_slab_t *slabs;
+	p_node_t *free_nodes;
+
+	/* Number of heap allocations made by this queue so far */
+	unsigned long allocations;
+
+	/* Number of comparer calls made so far (only counted with PRIQUEUE_STATS) */
+	unsigned long comparisons;
+
+	/* PRIQUEUE_HEAP: d-ary min-heap stored contiguously in heap[0..size) */
+	int arity;
+	int capacity;
+	unsigned long seq;
+	p_entry_t *heap;
+
+	/* Sorted copy of the heap used by priqueue_at(), rebuilt lazily */
+	p_entry_t *order;
+	int order_valid;
+
+	/* Handle -> heap slot (-1 when unused) and the stack of unused handles */
+	int *positions;
+	int *free_handles;
+	int free_count;
+
+	/* PRIQUEUE_FIFO: growable ring buffer, capacity is a power of two */
+	int head;
+	void **ring;
+
+	/* PRIQUEUE_BUCKET: one FIFO per key in [0, levels), occupancy bitmap,
+	   and a heap for elements whose key falls outside that range */
+	int levels;
+	int (*key) (const void *);
+	struct _priqueue_t *buckets;
+	unsigned long long *bitmap;
+	struct _priqueue_t *overflow;
 } priqueue_t;
 
+/**
+  Cursor over the elements of a priqueue_t in priority order.
+
+  The queue must not be modified while a cursor is in use.
+*/
+typedef struct _priqueue_iter_t
+{
+	priqueue_t *q;
+	int index;
+	p_node_t *node;
+
+	/* PRIQUEUE_BUCKET: current bucket, slot within it and overflow position */
+	int level;
+	int slot;
+	int overflow;
+} priqueue_iter_t;
+
 
 
 void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void *));
+int    priqueue_init_heap(priqueue_t *q, int(*comparer)(const void *, const void *), int arity);
+void   priqueue_init_fifo(priqueue_t *q);
+void   priqueue_init_buckets(priqueue_t *q, int(*comparer)(const void *, const void *), int(*key)(const void *), int levels);
 
 int    priqueue_offer    (priqueue_t *q, void *ptr);
+int    priqueue_offer_handle(priqueue_t *q, void *ptr);
+void * priqueue_handle_get(priqueue_t *q, int handle);
+int    priqueue_update_key(priqueue_t *q, int handle);
+void * priqueue_remove_handle(priqueue_t *q, int handle);
 void * priqueue_peek     (priqueue_t *q);
 void * priqueue_poll     (priqueue_t *q);
 void * priqueue_at       (priqueue_t *q, int index);
@@ -38,6 +147,12 @@ int    priqueue_remove   (priqueue_t *q, void *ptr);
 void * priqueue_remove_at(priqueue_t *q, int index);
 int    priqueue_size     (priqueue_t *q);
 
+void   priqueue_iter_begin(priqueue_t *q, priqueue_iter_t *it);
+void * priqueue_iter_next (priqueue_iter_t *it);
+int    priqueue_snapshot  (priqueue_t *q, void **buf, int n);
+unsigned long priqueue_allocations(priqueue_t *q);
+unsigned long priqueue_comparisons(priqueue_t *q);
+
 void   priqueue_destroy  (priqueue_t *q);
 
 #endif /* LIBPQUEUE_H_ */
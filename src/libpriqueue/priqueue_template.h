@@ -0,0 +1,1199 @@
+/** @file priqueue_template.h
+ */
+
+#ifndef PRIQUEUE_TEMPLATE_H_
+#define PRIQUEUE_TEMPLATE_H_
+
+#include <stdlib.h>
+
+#include "libpriqueue.h"
+
+/**
+  Defines a d-ary min-heap specialized for one key type, as name_t with
+  functions name_init(), name_offer(), name_peek(), name_poll(), name_size(),
+  name_sort(), name_at(), name_truncate(), name_split(), name_comparisons(),
+  name_allocations() and name_destroy().
+
+  Unlike priqueue_t, which calls a comparer on the jobs themselves, each
+  entry stores its sort key inline next to the value. Comparisons are
+  then integer compares over the contiguous entry array, inlined into the
+  sift loops. The caller computes the key when it offers a value, and the
+  key must not change while the value is queued. Entries with equal keys
+  leave in the order they were offered in, as they do from priqueue_t.
+  Comparisons are counted under PRIQUEUE_STATS.
+
+  @param name the prefix of the generated type and functions
+  @param key_type an integer type; smaller keys leave the queue first
+  @param value_type the type of the queued values, eg. a pointer or an index
+  @param empty the value returned when there is nothing to return
+  @param arity the number of children per node
+*/
+#define PRIQUEUE_HEAP_TEMPLATE(name, key_type, value_type, empty, arity)       \
+                                                                               \
+typedef struct _##name##_entry_t                                               \
+{                                                                              \
+	key_type key;                                                              \
+	value_type value;                                                          \
+	unsigned long seq;                                                         \
+} name##_entry_t;                                                              \
+                                                                               \
+typedef struct _##name##_t                                                     \
+{                                                                              \
+	int size;                                                                  \
+	int capacity;                                                              \
+	int sorted;                                                                \
+	unsigned long seq;                                                         \
+	name##_entry_t *heap;                                                      \
+	unsigned long allocations;                                                 \
+	unsigned long comparisons;                                                 \
+} name##_t;                                                                    \
+                                                                               \
+static inline int name##_less(name##_t *q, const name##_entry_t *a,            \
+		const name##_entry_t *b)                                               \
+{                                                                              \
+	if(PRIQUEUE_STATS)                                                         \
+	{                                                                          \
+		q->comparisons++;                                                      \
+	}                                                                          \
+	return a->key < b->key || (a->key == b->key && a->seq < b->seq);           \
+}                                                                              \
+                                                                               \
+static int name##_entry_compare(const void *a, const void *b)                  \
+{                                                                              \
+	const name##_entry_t *x = a, *y = b;                                       \
+	if(x->key != y->key)                                                       \
+	{                                                                          \
+		return x->key < y->key ? -1 : 1;                                       \
+	}                                                                          \
+	return x->seq < y->seq ? -1 : (x->seq > y->seq);                           \
+}                                                                              \
+                                                                               \
+static inline void name##_init(name##_t *q)                                    \
+{                                                                              \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+	q->sorted = 1;                                                             \
+	q->seq = 0;                                                                \
+	q->heap = NULL;                                                            \
+	q->allocations = 0;                                                        \
+	q->comparisons = 0;                                                        \
+}                                                                              \
+                                                                               \
+/* Returns the position the job was placed at, or -1 if memory ran out */     \
+static inline int name##_offer(name##_t *q, key_type key, value_type value)   \
+{                                                                              \
+	if(q->size == q->capacity)                                                 \
+	{                                                                          \
+		int capacity = q->capacity ? q->capacity * 2 : 16;                     \
+		name##_entry_t *heap = realloc(q->heap,                                \
+				capacity * sizeof(name##_entry_t));                            \
+		if(heap == NULL)                                                       \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		q->heap = heap;                                                        \
+		q->capacity = capacity;                                                \
+		q->allocations++;                                                      \
+	}                                                                          \
+                                                                               \
+	name##_entry_t entry = {key, value, q->seq++};                             \
+	int index = q->size++;                                                     \
+	q->sorted = 0;                                                             \
+	while(index > 0)                                                           \
+	{                                                                          \
+		int parent = (index - 1) / (arity);                                    \
+		if(!name##_less(q, &entry, &q->heap[parent]))                          \
+		{                                                                      \
+			break;                                                             \
+		}                                                                      \
+		q->heap[index] = q->heap[parent];                                      \
+		index = parent;                                                        \
+	}                                                                          \
+	q->heap[index] = entry;                                                    \
+	return index;                                                              \
+}                                                                              \
+                                                                               \
+static inline value_type name##_peek(name##_t *q)                              \
+{                                                                              \
+	return q->size > 0 ? q->heap[0].value : (empty);                           \
+}                                                                              \
+                                                                               \
+/* Puts entry at index, or below it if one of its children is less */          \
+static inline void name##_sift_down(name##_t *q, int index,                    \
+		name##_entry_t entry)                                                  \
+{                                                                              \
+	while(1)                                                                   \
+	{                                                                          \
+		int first = index * (arity) + 1;                                       \
+		if(first >= q->size)                                                   \
+		{                                                                      \
+			break;                                                             \
+		}                                                                      \
+		int last = first + (arity) < q->size ? first + (arity) : q->size;      \
+		int best = first;                                                      \
+		for(int i = first + 1; i < last; i++)                                  \
+		{                                                                      \
+			if(name##_less(q, &q->heap[i], &q->heap[best]))                    \
+			{                                                                  \
+				best = i;                                                      \
+			}                                                                  \
+		}                                                                      \
+		if(!name##_less(q, &q->heap[best], &entry))                            \
+		{                                                                      \
+			break;                                                             \
+		}                                                                      \
+		q->heap[index] = q->heap[best];                                        \
+		index = best;                                                          \
+	}                                                                          \
+	q->heap[index] = entry;                                                    \
+}                                                                              \
+                                                                               \
+static inline value_type name##_poll(name##_t *q)                              \
+{                                                                              \
+	if(q->size == 0)                                                           \
+	{                                                                          \
+		return (empty);                                                        \
+	}                                                                          \
+                                                                               \
+	value_type value = q->heap[0].value;                                       \
+	q->size--;                                                                 \
+	q->sorted = 0;                                                             \
+	name##_sift_down(q, 0, q->heap[q->size]);                                  \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+static inline int name##_size(name##_t *q)                                     \
+{                                                                              \
+	return q->size;                                                            \
+}                                                                              \
+                                                                               \
+/* Sorts the entries into priority order; a sorted array is still a heap. */   \
+/* Nothing is done if no entry came or went since the last sort */             \
+static inline void name##_sort(name##_t *q)                                    \
+{                                                                              \
+	if(q->sorted)                                                              \
+	{                                                                          \
+		return;                                                                \
+	}                                                                          \
+	qsort(q->heap, q->size, sizeof(name##_entry_t), name##_entry_compare);     \
+	q->sorted = 1;                                                             \
+}                                                                              \
+                                                                               \
+/* The value at index, which is its place in priority order after _sort() */ \
+static inline value_type name##_at(name##_t *q, int index)                     \
+{                                                                              \
+	return index >= 0 && index < q->size ? q->heap[index].value : (empty);     \
+}                                                                              \
+                                                                               \
+/* Drops every entry from size on; only keeps a heap right after _sort() */  \
+static inline void name##_truncate(name##_t *q, int size)                      \
+{                                                                              \
+	if(size < q->size)                                                         \
+	{                                                                          \
+		q->size = size;                                                        \
+	}                                                                          \
+}                                                                              \
+                                                                               \
+/* Moves the count greatest entries into to, by selection rather than a */     \
+/* sort. They keep their order relative to each other and to later offers */   \
+/* to to, which should be empty. Returns 0, or -1 if memory ran out */         \
+static inline int name##_split(name##_t *q, name##_t *to, int count)           \
+{                                                                              \
+	count = count < q->size ? count : q->size;                                 \
+	if(count <= 0)                                                             \
+	{                                                                          \
+		return 0;                                                              \
+	}                                                                          \
+	if(to->size + count > to->capacity)                                        \
+	{                                                                          \
+		int capacity = to->capacity ? to->capacity : 16;                       \
+		while(capacity < to->size + count)                                     \
+		{                                                                      \
+			capacity *= 2;                                                     \
+		}                                                                      \
+		name##_entry_t *heap = realloc(to->heap,                               \
+				capacity * sizeof(name##_entry_t));                            \
+		if(heap == NULL)                                                       \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		to->heap = heap;                                                       \
+		to->capacity = capacity;                                               \
+		to->allocations++;                                                     \
+	}                                                                          \
+                                                                               \
+	/* Quickselect, so every entry from keep on is greater than those before */ \
+	int keep = q->size - count;                                                \
+	int lo = 0, hi = q->size - 1;                                              \
+	while(keep > 0 && !q->sorted && lo < hi)                                   \
+	{                                                                          \
+		name##_entry_t pivot = q->heap[lo + (hi - lo) / 2];                    \
+		int i = lo, j = hi;                                                    \
+		while(i <= j)                                                          \
+		{                                                                      \
+			while(name##_less(q, &q->heap[i], &pivot))                         \
+			{                                                                  \
+				i++;                                                           \
+			}                                                                  \
+			while(name##_less(q, &pivot, &q->heap[j]))                         \
+			{                                                                  \
+				j--;                                                           \
+			}                                                                  \
+			if(i <= j)                                                         \
+			{                                                                  \
+				name##_entry_t swap = q->heap[i];                              \
+				q->heap[i++] = q->heap[j];                                     \
+				q->heap[j--] = swap;                                           \
+			}                                                                  \
+		}                                                                      \
+		if(keep <= j)                                                          \
+		{                                                                      \
+			hi = j;                                                            \
+		}                                                                      \
+		else if(keep >= i)                                                     \
+		{                                                                      \
+			lo = i;                                                            \
+		}                                                                      \
+		else                                                                   \
+		{                                                                      \
+			break;                                                             \
+		}                                                                      \
+	}                                                                          \
+                                                                               \
+	/* The entries keep their seq, and to's later offers come after them */    \
+	for(int i = 0; i < count; i++)                                             \
+	{                                                                          \
+		to->heap[to->size++] = q->heap[keep + i];                              \
+	}                                                                          \
+	q->size = keep;                                                            \
+	to->seq = to->seq > q->seq ? to->seq : q->seq;                             \
+	to->sorted = 0;                                                            \
+                                                                               \
+	/* Rebuild both heaps bottom up; a sorted prefix is one already */         \
+	name##_t *heaps[2] = {q, to};                                              \
+	for(int h = 0; h < 2; h++)                                                 \
+	{                                                                          \
+		if(heaps[h]->sorted || heaps[h]->size < 2)                             \
+		{                                                                      \
+			continue;                                                          \
+		}                                                                      \
+		for(int i = (heaps[h]->size - 2) / (arity); i >= 0; i--)               \
+		{                                                                      \
+			name##_sift_down(heaps[h], i, heaps[h]->heap[i]);                  \
+		}                                                                      \
+	}                                                                          \
+	return 0;                                                                  \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_comparisons(name##_t *q)                    \
+{                                                                              \
+	return q->comparisons;                                                     \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_allocations(name##_t *q)                    \
+{                                                                              \
+	return q->allocations;                                                     \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *q)                                 \
+{                                                                              \
+	free(q->heap);                                                             \
+	q->heap = NULL;                                                            \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+}
+
+/**
+  Defines a FIFO ring buffer of one value type, as name_t with functions
+  name_init(), name_offer(), name_poll(), name_size(), name_at(),
+  name_truncate(), name_allocations() and name_destroy(). It stores the
+  values themselves, so a queue of 32-bit indices takes half the memory of
+  priqueue_t's pointers.
+
+  @param name the prefix of the generated type and functions
+  @param value_type the type of the queued values
+  @param empty the value returned when there is nothing to return
+*/
+#define PRIQUEUE_FIFO_TEMPLATE(name, value_type, empty)                        \
+                                                                               \
+typedef struct _##name##_t                                                     \
+{                                                                              \
+	int head;                                                                  \
+	int size;                                                                  \
+	int capacity;                                                              \
+	value_type *ring;                                                          \
+	unsigned long allocations;                                                 \
+} name##_t;                                                                    \
+                                                                               \
+static inline void name##_init(name##_t *q)                                    \
+{                                                                              \
+	q->head = 0;                                                               \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+	q->ring = NULL;                                                            \
+	q->allocations = 0;                                                        \
+}                                                                              \
+                                                                               \
+/* Returns the position the value was placed at, or -1 if memory ran out */   \
+static inline int name##_offer(name##_t *q, value_type value)                  \
+{                                                                              \
+	if(q->size == q->capacity)                                                 \
+	{                                                                          \
+		int capacity = q->capacity ? q->capacity * 2 : 16;                     \
+		value_type *ring = realloc(q->ring, capacity * sizeof(value_type));    \
+		if(ring == NULL)                                                       \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		/* Unwrap: move the values before head past the old end */             \
+		for(int i = 0; i < q->head; i++)                                       \
+		{                                                                      \
+			ring[q->capacity + i] = ring[i];                                   \
+		}                                                                      \
+		q->ring = ring;                                                        \
+		q->capacity = capacity;                                                \
+		q->allocations++;                                                      \
+	}                                                                          \
+                                                                               \
+	q->ring[(q->head + q->size) & (q->capacity - 1)] = value;                  \
+	return q->size++;                                                          \
+}                                                                              \
+                                                                               \
+static inline value_type name##_poll(name##_t *q)                              \
+{                                                                              \
+	if(q->size == 0)                                                           \
+	{                                                                          \
+		return (empty);                                                        \
+	}                                                                          \
+                                                                               \
+	value_type value = q->ring[q->head];                                       \
+	q->head = (q->head + 1) & (q->capacity - 1);                               \
+	q->size--;                                                                 \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+static inline int name##_size(name##_t *q)                                     \
+{                                                                              \
+	return q->size;                                                            \
+}                                                                              \
+                                                                               \
+static inline value_type name##_at(name##_t *q, int index)                     \
+{                                                                              \
+	if(index < 0 || index >= q->size)                                          \
+	{                                                                          \
+		return (empty);                                                        \
+	}                                                                          \
+	return q->ring[(q->head + index) & (q->capacity - 1)];                     \
+}                                                                              \
+                                                                               \
+/* Drops the newest values, keeping the oldest size */                        \
+static inline void name##_truncate(name##_t *q, int size)                      \
+{                                                                              \
+	if(size < q->size)                                                         \
+	{                                                                          \
+		q->size = size;                                                        \
+	}                                                                          \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_allocations(name##_t *q)                    \
+{                                                                              \
+	return q->allocations;                                                     \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *q)                                 \
+{                                                                              \
+	free(q->ring);                                                             \
+	q->ring = NULL;                                                            \
+	q->head = 0;                                                               \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+}
+
+/**
+  Defines a red-black tree ordered by one key type, as name_t with the same
+  functions as PRIQUEUE_HEAP_TEMPLATE(): name_init(), name_offer(),
+  name_peek(), name_poll(), name_size(), name_sort(), name_at(),
+  name_truncate(), name_comparisons(), name_allocations() and
+  name_destroy().
+
+  Offers and polls are O(log n) as in the heap, but the tree is always in
+  order, so the smallest entry is kept at hand for peeks and _sort() only
+  lists the entries instead of sorting them. Nodes live in one array and
+  refer to each other by index; index 0 is the black sentinel that stands
+  for every leaf, and freed nodes are chained through their right index.
+  Entries with equal keys leave in the order they were offered in.
+  Comparisons are counted under PRIQUEUE_STATS.
+
+  @param name the prefix of the generated type and functions
+  @param key_type an integer type; smaller keys leave the queue first
+  @param value_type the type of the queued values, eg. a pointer or an index
+  @param empty the value returned when there is nothing to return
+*/
+#define PRIQUEUE_RBTREE_TEMPLATE(name, key_type, value_type, empty)           \
+                                                                               \
+typedef struct _##name##_node_t                                                \
+{                                                                              \
+	key_type key;                                                              \
+	value_type value;                                                          \
+	unsigned long seq;                                                         \
+	int left, right, parent;                                                   \
+	int red;                                                                   \
+} name##_node_t;                                                               \
+                                                                               \
+typedef struct _##name##_t                                                     \
+{                                                                              \
+	int size;                                                                  \
+	int capacity;                                                              \
+	int root;                                                                  \
+	int leftmost;                                                              \
+	int free;                                                                  \
+	unsigned long seq;                                                         \
+	name##_node_t *nodes;                                                      \
+	int *order;                                                                \
+	int order_capacity;                                                        \
+	int sorted;                                                                \
+	unsigned long allocations;                                                 \
+	unsigned long comparisons;                                                 \
+} name##_t;                                                                    \
+                                                                               \
+static inline int name##_less(name##_t *q, int a, int b)                       \
+{                                                                              \
+	const name##_node_t *x = &q->nodes[a], *y = &q->nodes[b];                  \
+	if(PRIQUEUE_STATS)                                                         \
+	{                                                                          \
+		q->comparisons++;                                                      \
+	}                                                                          \
+	return x->key < y->key || (x->key == y->key && x->seq < y->seq);           \
+}                                                                              \
+                                                                               \
+static inline void name##_init(name##_t *q)                                    \
+{                                                                              \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+	q->root = 0;                                                               \
+	q->leftmost = 0;                                                           \
+	q->free = 0;                                                               \
+	q->seq = 0;                                                                \
+	q->nodes = NULL;                                                           \
+	q->order = NULL;                                                           \
+	q->order_capacity = 0;                                                     \
+	q->sorted = 1;                                                             \
+	q->allocations = 0;                                                        \
+	q->comparisons = 0;                                                        \
+}                                                                              \
+                                                                               \
+/* Makes x's right child y its parent */                                      \
+static inline void name##_rotate_left(name##_t *q, int x)                      \
+{                                                                              \
+	name##_node_t *n = q->nodes;                                               \
+	int y = n[x].right;                                                        \
+	n[x].right = n[y].left;                                                    \
+	if(n[y].left != 0)                                                         \
+	{                                                                          \
+		n[n[y].left].parent = x;                                               \
+	}                                                                          \
+	n[y].parent = n[x].parent;                                                 \
+	if(n[x].parent == 0)                                                       \
+	{                                                                          \
+		q->root = y;                                                           \
+	}                                                                          \
+	else if(x == n[n[x].parent].left)                                          \
+	{                                                                          \
+		n[n[x].parent].left = y;                                               \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		n[n[x].parent].right = y;                                              \
+	}                                                                          \
+	n[y].left = x;                                                             \
+	n[x].parent = y;                                                           \
+}                                                                              \
+                                                                               \
+/* Makes x's left child y its parent */                                       \
+static inline void name##_rotate_right(name##_t *q, int x)                     \
+{                                                                              \
+	name##_node_t *n = q->nodes;                                               \
+	int y = n[x].left;                                                         \
+	n[x].left = n[y].right;                                                    \
+	if(n[y].right != 0)                                                        \
+	{                                                                          \
+		n[n[y].right].parent = x;                                              \
+	}                                                                          \
+	n[y].parent = n[x].parent;                                                 \
+	if(n[x].parent == 0)                                                       \
+	{                                                                          \
+		q->root = y;                                                           \
+	}                                                                          \
+	else if(x == n[n[x].parent].right)                                         \
+	{                                                                          \
+		n[n[x].parent].right = y;                                              \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		n[n[x].parent].left = y;                                               \
+	}                                                                          \
+	n[y].right = x;                                                            \
+	n[x].parent = y;                                                           \
+}                                                                              \
+                                                                               \
+/* Returns the node after x in order, or 0 */                                 \
+static inline int name##_next(name##_t *q, int x)                              \
+{                                                                              \
+	name##_node_t *n = q->nodes;                                               \
+	if(n[x].right != 0)                                                        \
+	{                                                                          \
+		for(x = n[x].right; n[x].left != 0; x = n[x].left);                    \
+		return x;                                                              \
+	}                                                                          \
+	while(n[x].parent != 0 && x == n[n[x].parent].right)                       \
+	{                                                                          \
+		x = n[x].parent;                                                       \
+	}                                                                          \
+	return n[x].parent;                                                        \
+}                                                                              \
+                                                                               \
+/* Returns 0 on success, or -1 if memory ran out */                           \
+static inline int name##_offer(name##_t *q, key_type key, value_type value)   \
+{                                                                              \
+	if(q->free == 0)                                                           \
+	{                                                                          \
+		int capacity = q->capacity ? q->capacity * 2 : 16;                     \
+		name##_node_t *nodes = realloc(q->nodes,                               \
+				capacity * sizeof(name##_node_t));                             \
+		if(nodes == NULL)                                                      \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		if(q->capacity == 0)                                                   \
+		{                                                                      \
+			nodes[0].red = 0;                                                  \
+			q->capacity = 1;                                                   \
+		}                                                                      \
+		for(int i = capacity - 1; i >= q->capacity; i--)                       \
+		{                                                                      \
+			nodes[i].right = q->free;                                          \
+			q->free = i;                                                       \
+		}                                                                      \
+		q->nodes = nodes;                                                      \
+		q->capacity = capacity;                                                \
+		q->allocations++;                                                      \
+	}                                                                          \
+                                                                               \
+	name##_node_t *n = q->nodes;                                               \
+	int z = q->free;                                                           \
+	q->free = n[z].right;                                                      \
+	n[z].key = key;                                                            \
+	n[z].value = value;                                                        \
+	n[z].seq = q->seq++;                                                       \
+	n[z].left = n[z].right = 0;                                                \
+	n[z].red = 1;                                                              \
+                                                                               \
+	int parent = 0, x = q->root, leftmost = 1, left = 0;                       \
+	while(x != 0)                                                              \
+	{                                                                          \
+		parent = x;                                                            \
+		left = name##_less(q, z, x);                                           \
+		x = left ? n[x].left : n[x].right;                                     \
+		leftmost &= left;                                                      \
+	}                                                                          \
+	n[z].parent = parent;                                                      \
+	if(parent == 0)                                                            \
+	{                                                                          \
+		q->root = z;                                                           \
+	}                                                                          \
+	else if(left)                                                              \
+	{                                                                          \
+		n[parent].left = z;                                                    \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		n[parent].right = z;                                                   \
+	}                                                                          \
+	if(leftmost)                                                               \
+	{                                                                          \
+		q->leftmost = z;                                                       \
+	}                                                                          \
+	q->size++;                                                                 \
+	q->sorted = 0;                                                             \
+                                                                               \
+	/* Repaint or rotate until no red node has a red parent */                 \
+	while(n[n[z].parent].red)                                                  \
+	{                                                                          \
+		int p = n[z].parent, g = n[p].parent;                                  \
+		if(p == n[g].left)                                                     \
+		{                                                                      \
+			int uncle = n[g].right;                                            \
+			if(n[uncle].red)                                                   \
+			{                                                                  \
+				n[p].red = n[uncle].red = 0;                                   \
+				n[g].red = 1;                                                  \
+				z = g;                                                         \
+				continue;                                                      \
+			}                                                                  \
+			if(z == n[p].right)                                                \
+			{                                                                  \
+				z = p;                                                         \
+				name##_rotate_left(q, z);                                      \
+				p = n[z].parent;                                               \
+			}                                                                  \
+			n[p].red = 0;                                                      \
+			n[g].red = 1;                                                      \
+			name##_rotate_right(q, g);                                         \
+		}                                                                      \
+		else                                                                   \
+		{                                                                      \
+			int uncle = n[g].left;                                             \
+			if(n[uncle].red)                                                   \
+			{                                                                  \
+				n[p].red = n[uncle].red = 0;                                   \
+				n[g].red = 1;                                                  \
+				z = g;                                                         \
+				continue;                                                      \
+			}                                                                  \
+			if(z == n[p].left)                                                 \
+			{                                                                  \
+				z = p;                                                         \
+				name##_rotate_right(q, z);                                     \
+				p = n[z].parent;                                               \
+			}                                                                  \
+			n[p].red = 0;                                                      \
+			n[g].red = 1;                                                      \
+			name##_rotate_left(q, g);                                          \
+		}                                                                      \
+	}                                                                          \
+	n[q->root].red = 0;                                                        \
+	return 0;                                                                  \
+}                                                                              \
+                                                                               \
+/* Puts v where u was; the sentinel's parent is set too, for _remove() */     \
+static inline void name##_transplant(name##_t *q, int u, int v)                \
+{                                                                              \
+	name##_node_t *n = q->nodes;                                               \
+	if(n[u].parent == 0)                                                       \
+	{                                                                          \
+		q->root = v;                                                           \
+	}                                                                          \
+	else if(u == n[n[u].parent].left)                                          \
+	{                                                                          \
+		n[n[u].parent].left = v;                                               \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		n[n[u].parent].right = v;                                              \
+	}                                                                          \
+	n[v].parent = n[u].parent;                                                 \
+}                                                                              \
+                                                                               \
+/* Unlinks node z and frees it. Other nodes keep their index */               \
+static inline void name##_remove(name##_t *q, int z)                           \
+{                                                                              \
+	name##_node_t *n = q->nodes;                                               \
+	int y = z, x, removed_red = n[z].red;                                      \
+                                                                               \
+	if(z == q->leftmost)                                                       \
+	{                                                                          \
+		q->leftmost = name##_next(q, z);                                       \
+	}                                                                          \
+                                                                               \
+	if(n[z].left == 0)                                                         \
+	{                                                                          \
+		x = n[z].right;                                                        \
+		name##_transplant(q, z, x);                                            \
+	}                                                                          \
+	else if(n[z].right == 0)                                                   \
+	{                                                                          \
+		x = n[z].left;                                                         \
+		name##_transplant(q, z, x);                                            \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		for(y = n[z].right; n[y].left != 0; y = n[y].left);                    \
+		removed_red = n[y].red;                                                \
+		x = n[y].right;                                                        \
+		if(n[y].parent == z)                                                   \
+		{                                                                      \
+			n[x].parent = y;                                                   \
+		}                                                                      \
+		else                                                                   \
+		{                                                                      \
+			name##_transplant(q, y, n[y].right);                               \
+			n[y].right = n[z].right;                                           \
+			n[n[y].right].parent = y;                                          \
+		}                                                                      \
+		name##_transplant(q, z, y);                                            \
+		n[y].left = n[z].left;                                                 \
+		n[n[y].left].parent = y;                                               \
+		n[y].red = n[z].red;                                                   \
+	}                                                                          \
+                                                                               \
+	/* x carries an extra black; move it up or rotate it away */              \
+	while(!removed_red && x != q->root && !n[x].red)                           \
+	{                                                                          \
+		int p = n[x].parent;                                                   \
+		if(x == n[p].left)                                                     \
+		{                                                                      \
+			int w = n[p].right;                                                \
+			if(n[w].red)                                                       \
+			{                                                                  \
+				n[w].red = 0;                                                  \
+				n[p].red = 1;                                                  \
+				name##_rotate_left(q, p);                                      \
+				w = n[p].right;                                                \
+			}                                                                  \
+			if(!n[n[w].left].red && !n[n[w].right].red)                        \
+			{                                                                  \
+				n[w].red = 1;                                                  \
+				x = p;                                                         \
+				continue;                                                      \
+			}                                                                  \
+			if(!n[n[w].right].red)                                             \
+			{                                                                  \
+				n[n[w].left].red = 0;                                          \
+				n[w].red = 1;                                                  \
+				name##_rotate_right(q, w);                                     \
+				w = n[p].right;                                                \
+			}                                                                  \
+			n[w].red = n[p].red;                                               \
+			n[p].red = 0;                                                      \
+			n[n[w].right].red = 0;                                             \
+			name##_rotate_left(q, p);                                          \
+		}                                                                      \
+		else                                                                   \
+		{                                                                      \
+			int w = n[p].left;                                                 \
+			if(n[w].red)                                                       \
+			{                                                                  \
+				n[w].red = 0;                                                  \
+				n[p].red = 1;                                                  \
+				name##_rotate_right(q, p);                                     \
+				w = n[p].left;                                                 \
+			}                                                                  \
+			if(!n[n[w].left].red && !n[n[w].right].red)                        \
+			{                                                                  \
+				n[w].red = 1;                                                  \
+				x = p;                                                         \
+				continue;                                                      \
+			}                                                                  \
+			if(!n[n[w].left].red)                                              \
+			{                                                                  \
+				n[n[w].right].red = 0;                                         \
+				n[w].red = 1;                                                  \
+				name##_rotate_left(q, w);                                      \
+				w = n[p].left;                                                 \
+			}                                                                  \
+			n[w].red = n[p].red;                                               \
+			n[p].red = 0;                                                      \
+			n[n[w].left].red = 0;                                              \
+			name##_rotate_right(q, p);                                         \
+		}                                                                      \
+		x = q->root;                                                           \
+	}                                                                          \
+	n[x].red = 0;                                                              \
+                                                                               \
+	n[z].right = q->free;                                                      \
+	q->free = z;                                                               \
+	q->size--;                                                                 \
+	q->sorted = 0;                                                             \
+}                                                                              \
+                                                                               \
+static inline value_type name##_peek(name##_t *q)                              \
+{                                                                              \
+	return q->size > 0 ? q->nodes[q->leftmost].value : (empty);                \
+}                                                                              \
+                                                                               \
+static inline value_type name##_poll(name##_t *q)                              \
+{                                                                              \
+	if(q->size == 0)                                                           \
+	{                                                                          \
+		return (empty);                                                        \
+	}                                                                          \
+                                                                               \
+	value_type value = q->nodes[q->leftmost].value;                            \
+	name##_remove(q, q->leftmost);                                             \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+static inline int name##_size(name##_t *q)                                     \
+{                                                                              \
+	return q->size;                                                            \
+}                                                                              \
+                                                                               \
+/* Lists the nodes in order for _at() and _truncate(); no comparisons. */      \
+/* The list is kept until an entry comes or goes */                            \
+static inline void name##_sort(name##_t *q)                                    \
+{                                                                              \
+	if(q->sorted)                                                              \
+	{                                                                          \
+		return;                                                                \
+	}                                                                          \
+	if(q->size > q->order_capacity)                                            \
+	{                                                                          \
+		int *order = realloc(q->order, q->capacity * sizeof(int));             \
+		if(order == NULL)                                                      \
+		{                                                                      \
+			return;                                                            \
+		}                                                                      \
+		q->order = order;                                                      \
+		q->order_capacity = q->capacity;                                       \
+		q->allocations++;                                                      \
+	}                                                                          \
+	int i = 0;                                                                 \
+	for(int x = q->leftmost; i < q->size; x = name##_next(q, x))               \
+	{                                                                          \
+		q->order[i++] = x;                                                     \
+	}                                                                          \
+	q->sorted = 1;                                                             \
+}                                                                              \
+                                                                               \
+/* The value at index in priority order; only valid right after _sort() */   \
+static inline value_type name##_at(name##_t *q, int index)                     \
+{                                                                              \
+	return q->sorted && index >= 0 && index < q->size                          \
+			? q->nodes[q->order[index]].value : (empty);                       \
+}                                                                              \
+                                                                               \
+/* Drops every entry from size on; only valid right after _sort() */         \
+static inline void name##_truncate(name##_t *q, int size)                      \
+{                                                                              \
+	int sorted = q->sorted;                                                    \
+	for(int i = q->size - 1; i >= size && i >= 0; i--)                         \
+	{                                                                          \
+		name##_remove(q, q->order[i]);                                         \
+	}                                                                          \
+	/* What is left of the list is still in order */                           \
+	q->sorted = sorted;                                                        \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_comparisons(name##_t *q)                    \
+{                                                                              \
+	return q->comparisons;                                                     \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_allocations(name##_t *q)                    \
+{                                                                              \
+	return q->allocations;                                                     \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *q)                                 \
+{                                                                              \
+	free(q->nodes);                                                            \
+	free(q->order);                                                            \
+	q->nodes = NULL;                                                           \
+	q->order = NULL;                                                           \
+	q->size = 0;                                                               \
+	q->capacity = 0;                                                           \
+	q->root = 0;                                                               \
+	q->leftmost = 0;                                                           \
+	q->free = 0;                                                               \
+	q->order_capacity = 0;                                                     \
+}
+
+/**
+  Defines a bucket queue for keys whose high bits fall in a small range, as
+  name_t with the same functions as PRIQUEUE_HEAP_TEMPLATE() but
+  name_split(). It is the inline-key counterpart of priqueue_init_buckets().
+
+  A key's level is key >> shift. Each level in [0, levels) has a ring buffer
+  kept in key order, so an offer is O(1) when keys of a level come in order
+  and a poll is always O(1): a bit per level is set while its ring is not
+  empty, and the lowest set bit is the front level. Keys of other levels go
+  to a heap, name_overflow_t. Entries with equal keys leave in the order
+  they were offered in. Comparisons are counted under PRIQUEUE_STATS.
+
+  @param name the prefix of the generated type and functions
+  @param key_type a signed integer type; smaller keys leave the queue first
+  @param value_type the type of the queued values, eg. a pointer or an index
+  @param empty the value returned when there is nothing to return
+  @param levels the number of levels with a ring, at most 64
+  @param shift the number of low key bits that do not decide the level
+  @param arity the number of children per node of the overflow heap
+*/
+#define PRIQUEUE_BUCKET_TEMPLATE(name, key_type, value_type, empty, levels,    \
+		shift, arity)                                                          \
+PRIQUEUE_HEAP_TEMPLATE(name##_overflow, key_type, value_type, empty, arity)    \
+                                                                               \
+typedef struct _##name##_slot_t                                                \
+{                                                                              \
+	key_type key;                                                              \
+	value_type value;                                                          \
+} name##_slot_t;                                                               \
+                                                                               \
+typedef struct _##name##_ring_t                                                \
+{                                                                              \
+	int head;                                                                  \
+	int size;                                                                  \
+	int capacity;                                                              \
+	name##_slot_t *slots;                                                      \
+} name##_ring_t;                                                               \
+                                                                               \
+typedef struct _##name##_t                                                     \
+{                                                                              \
+	int size;                                                                  \
+	unsigned long long nonempty;                                               \
+	name##_ring_t rings[levels];                                               \
+	name##_overflow_t overflow;                                                \
+	value_type *order;                                                         \
+	int order_capacity;                                                        \
+	int sorted;                                                                \
+	unsigned long allocations;                                                 \
+	unsigned long comparisons;                                                 \
+} name##_t;                                                                    \
+                                                                               \
+static inline key_type name##_level(key_type key)                              \
+{                                                                              \
+	return key >> (shift);                                                     \
+}                                                                              \
+                                                                               \
+static inline int name##_less(name##_t *q, key_type a, key_type b)             \
+{                                                                              \
+	if(PRIQUEUE_STATS)                                                         \
+	{                                                                          \
+		q->comparisons++;                                                      \
+	}                                                                          \
+	return a < b;                                                              \
+}                                                                              \
+                                                                               \
+static inline name##_slot_t *name##_slot(name##_ring_t *r, int index)          \
+{                                                                              \
+	return &r->slots[(r->head + index) & (r->capacity - 1)];                   \
+}                                                                              \
+                                                                               \
+static inline void name##_init(name##_t *q)                                    \
+{                                                                              \
+	q->size = 0;                                                               \
+	q->nonempty = 0;                                                           \
+	for(int level = 0; level < (levels); level++)                              \
+	{                                                                          \
+		q->rings[level].head = 0;                                              \
+		q->rings[level].size = 0;                                              \
+		q->rings[level].capacity = 0;                                          \
+		q->rings[level].slots = NULL;                                          \
+	}                                                                          \
+	name##_overflow_init(&q->overflow);                                        \
+	q->order = NULL;                                                           \
+	q->order_capacity = 0;                                                     \
+	q->sorted = 1;                                                             \
+	q->allocations = 0;                                                        \
+	q->comparisons = 0;                                                        \
+}                                                                              \
+                                                                               \
+/* Returns 0 on success, or -1 if memory ran out */                            \
+static inline int name##_offer(name##_t *q, key_type key, value_type value)    \
+{                                                                              \
+	key_type level = name##_level(key);                                        \
+	if(level < 0 || level >= (levels))                                         \
+	{                                                                          \
+		if(name##_overflow_offer(&q->overflow, key, value) < 0)                \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		q->size++;                                                             \
+		q->sorted = 0;                                                         \
+		return 0;                                                              \
+	}                                                                          \
+                                                                               \
+	name##_ring_t *r = &q->rings[level];                                       \
+	if(r->size == r->capacity)                                                 \
+	{                                                                          \
+		int capacity = r->capacity ? r->capacity * 2 : 16;                     \
+		name##_slot_t *slots = realloc(r->slots,                               \
+				capacity * sizeof(name##_slot_t));                             \
+		if(slots == NULL)                                                      \
+		{                                                                      \
+			return -1;                                                         \
+		}                                                                      \
+		/* Unwrap: move the slots before head past the old end */              \
+		for(int i = 0; i < r->head; i++)                                       \
+		{                                                                      \
+			slots[r->capacity + i] = slots[i];                                 \
+		}                                                                      \
+		r->slots = slots;                                                      \
+		r->capacity = capacity;                                                \
+		q->allocations++;                                                      \
+	}                                                                          \
+                                                                               \
+	/* Walk back past greater keys; in-order keys stop at once */              \
+	int index = r->size++;                                                     \
+	while(index > 0 && name##_less(q, key, name##_slot(r, index - 1)->key))    \
+	{                                                                          \
+		*name##_slot(r, index) = *name##_slot(r, index - 1);                   \
+		index--;                                                               \
+	}                                                                          \
+	*name##_slot(r, index) = (name##_slot_t){key, value};                      \
+	q->nonempty |= 1ULL << level;                                              \
+	q->size++;                                                                 \
+	q->sorted = 0;                                                             \
+	return 0;                                                                  \
+}                                                                              \
+                                                                               \
+/* Returns the ring holding the least key, or NULL if it is in the heap */     \
+static inline name##_ring_t *name##_front(name##_t *q)                         \
+{                                                                              \
+	if(q->nonempty == 0)                                                       \
+	{                                                                          \
+		return NULL;                                                           \
+	}                                                                          \
+	name##_ring_t *r = &q->rings[__builtin_ctzll(q->nonempty)];                \
+	if(q->overflow.size > 0 &&                                                 \
+			name##_less(q, q->overflow.heap[0].key, name##_slot(r, 0)->key))   \
+	{                                                                          \
+		return NULL;                                                           \
+	}                                                                          \
+	return r;                                                                  \
+}                                                                              \
+                                                                               \
+static inline value_type name##_peek(name##_t *q)                              \
+{                                                                              \
+	name##_ring_t *r = name##_front(q);                                        \
+	return r != NULL ? name##_slot(r, 0)->value                                \
+			: name##_overflow_peek(&q->overflow);                              \
+}                                                                              \
+                                                                               \
+static inline value_type name##_poll(name##_t *q)                              \
+{                                                                              \
+	if(q->size == 0)                                                           \
+	{                                                                          \
+		return (empty);                                                        \
+	}                                                                          \
+                                                                               \
+	name##_ring_t *r = name##_front(q);                                        \
+	value_type value;                                                          \
+	if(r == NULL)                                                              \
+	{                                                                          \
+		value = name##_overflow_poll(&q->overflow);                            \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		value = name##_slot(r, 0)->value;                                      \
+		r->head = (r->head + 1) & (r->capacity - 1);                           \
+		if(--r->size == 0)                                                     \
+		{                                                                      \
+			q->nonempty &= ~(1ULL << (r - q->rings));                          \
+		}                                                                      \
+	}                                                                          \
+	q->size--;                                                                 \
+	q->sorted = 0;                                                             \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+static inline int name##_size(name##_t *q)                                     \
+{                                                                              \
+	return q->size;                                                            \
+}                                                                              \
+                                                                               \
+/* Lists the entries in order for _at() and _truncate(). Only the heap is */   \
+/* sorted, and the list is kept until an entry comes or goes */                \
+static inline void name##_sort(name##_t *q)                                    \
+{                                                                              \
+	if(q->sorted)                                                              \
+	{                                                                          \
+		return;                                                                \
+	}                                                                          \
+	if(q->size > q->order_capacity)                                            \
+	{                                                                          \
+		int capacity = q->order_capacity ? q->order_capacity : 16;             \
+		while(capacity < q->size)                                              \
+		{                                                                      \
+			capacity *= 2;                                                     \
+		}                                                                      \
+		value_type *order = realloc(q->order, capacity * sizeof(value_type));  \
+		if(order == NULL)                                                      \
+		{                                                                      \
+			return;                                                            \
+		}                                                                      \
+		q->order = order;                                                      \
+		q->order_capacity = capacity;                                          \
+		q->allocations++;                                                      \
+	}                                                                          \
+                                                                               \
+	/* Keys of the heap sort below every ring or above them all */             \
+	name##_overflow_t *o = &q->overflow;                                       \
+	name##_overflow_sort(o);                                                   \
+	int i = 0, below = 0;                                                      \
+	while(below < o->size && name##_level(o->heap[below].key) < 0)             \
+	{                                                                          \
+		q->order[i++] = o->heap[below++].value;                                \
+	}                                                                          \
+	for(unsigned long long bits = q->nonempty; bits != 0; bits &= bits - 1)    \
+	{                                                                          \
+		name##_ring_t *r = &q->rings[__builtin_ctzll(bits)];                   \
+		for(int j = 0; j < r->size; j++)                                       \
+		{                                                                      \
+			q->order[i++] = name##_slot(r, j)->value;                          \
+		}                                                                      \
+	}                                                                          \
+	for(int j = below; j < o->size; j++)                                       \
+	{                                                                          \
+		q->order[i++] = o->heap[j].value;                                      \
+	}                                                                          \
+	q->sorted = 1;                                                             \
+}                                                                              \
+                                                                               \
+/* The value at index in priority order; only valid right after _sort() */     \
+static inline value_type name##_at(name##_t *q, int index)                     \
+{                                                                              \
+	return q->sorted && index >= 0 && index < q->size ? q->order[index]        \
+			: (empty);                                                         \
+}                                                                              \
+                                                                               \
+/* Drops every entry from size on; only valid right after _sort() */           \
+static inline void name##_truncate(name##_t *q, int size)                      \
+{                                                                              \
+	name##_overflow_t *o = &q->overflow;                                       \
+	while(q->size > size && q->size > 0)                                       \
+	{                                                                          \
+		/* The sorted heap's last key is above every ring, or below them */    \
+		int drop = q->size - size;                                             \
+		if(o->size > 0 && name##_level(o->heap[o->size - 1].key) >= (levels))  \
+		{                                                                      \
+			name##_overflow_truncate(o, o->size - 1);                          \
+			drop = 1;                                                          \
+		}                                                                      \
+		else if(q->nonempty != 0)                                              \
+		{                                                                      \
+			int level = 63 - __builtin_clzll(q->nonempty);                     \
+			name##_ring_t *r = &q->rings[level];                               \
+			drop = drop < r->size ? drop : r->size;                            \
+			r->size -= drop;                                                   \
+			if(r->size == 0)                                                   \
+			{                                                                  \
+				q->nonempty &= ~(1ULL << level);                               \
+			}                                                                  \
+		}                                                                      \
+		else                                                                   \
+		{                                                                      \
+			name##_overflow_truncate(o, o->size - drop);                       \
+		}                                                                      \
+		q->size -= drop;                                                       \
+	}                                                                          \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_comparisons(name##_t *q)                    \
+{                                                                              \
+	return q->comparisons + name##_overflow_comparisons(&q->overflow);         \
+}                                                                              \
+                                                                               \
+static inline unsigned long name##_allocations(name##_t *q)                    \
+{                                                                              \
+	return q->allocations + name##_overflow_allocations(&q->overflow);         \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *q)                                 \
+{                                                                              \
+	for(int level = 0; level < (levels); level++)                              \
+	{                                                                          \
+		free(q->rings[level].slots);                                           \
+		q->rings[level].slots = NULL;                                          \
+		q->rings[level].head = 0;                                              \
+		q->rings[level].size = 0;                                              \
+		q->rings[level].capacity = 0;                                          \
+	}                                                                          \
+	name##_overflow_destroy(&q->overflow);                                     \
+	free(q->order);                                                            \
+	q->order = NULL;                                                           \
+	q->order_capacity = 0;                                                     \
+	q->nonempty = 0;                                                           \
+	q->size = 0;                                                               \
+}
+
+#endif /* PRIQUEUE_TEMPLATE_H_ */
@@ -7,82 +7,1183 @@
 
 #include "libscheduler.h"
 #include "../libpriqueue/libpriqueue.h"
+#include "../libpriqueue/priqueue_template.h"
+#include "../libhistogram/libhistogram.h"
 
-priqueue_t q;
 /**
-  Stores information making up a job to be scheduled including any statistics.
-  You may need to define some global variables or a struct to store your job queue elements.
+  Number of children per node in the heaps used by the SJF/PSJF queues, by
+  the PRI/PPRI queues for out-of-range priorities and for the running jobs.
 */
+#define SCHEDULER_HEAP_ARITY 4
 
 /**
-	A globally declared structure that contains all of the variables to be used
-	when calculating the metrics for the scheduler.
+  Priorities in [0, SCHEDULER_PRIORITY_LEVELS) get their own bucket in the
+  PRI/PPRI queue. Jobs with other priorities fall back to a heap.
 */
-scheduler_metrics_t s;
+#define SCHEDULER_PRIORITY_LEVELS 64
 
-int FCFS_COMPARE(const void * a, const void * b)
+/**
+  Number of jobs the job table first makes room for; it doubles from there.
+*/
+#define SCHEDULER_TABLE_JOBS 64
+
+/**
+  Number of cores tracked by each word of the idle-core bitmap.
+*/
+#define SCHEDULER_CORE_WORD_BITS 64
+
+
+/**
+  A job's index in its instance's job table. Queues and cores refer to jobs
+  by index, which takes half the room of a pointer.
+*/
+typedef unsigned int job_id_t;
+
+/**
+  The index standing for no job, eg. on an idle core.
+*/
+#define NO_JOB ((job_id_t)-1)
+
+/**
+  Weight of a CFS job of priority 0; virtual runtime is counted in 1/1024ths
+  of the time a job of that weight runs.
+*/
+#define SCHEDULER_CFS_WEIGHT_0 1024
+
+/**
+  Queue variants instantiated per scheme. The heap and buckets hold each
+  job's sort key inline: the time it has left for SJF/PSJF, and its priority
+  then arrival time for PRI/PPRI, whose bucket is the priority in the high
+  32 bits. FCFS and RR only need arrival order, as does each level of MLFQ.
+  CFS keeps its jobs in a red-black tree by virtual runtime.
+*/
+PRIQUEUE_FIFO_TEMPLATE(fifo_queue, job_id_t, NO_JOB)
+PRIQUEUE_HEAP_TEMPLATE(sjf_queue, int, job_id_t, NO_JOB, SCHEDULER_HEAP_ARITY)
+PRIQUEUE_BUCKET_TEMPLATE(pri_queue, long long, job_id_t, NO_JOB, SCHEDULER_PRIORITY_LEVELS, 32,
+                         SCHEDULER_HEAP_ARITY)
+PRIQUEUE_RBTREE_TEMPLATE(cfs_queue, long long, job_id_t, NO_JOB)
+
+/**
+  The waiting jobs of MLFQ: a FIFO per level, and a bit per level set while
+  its FIFO is not empty, so the highest waiting job is found in O(1).
+*/
+typedef struct _mlfq_queue_t
+{
+  fifo_queue_t *levels;
+  int num_levels;
+  unsigned int nonempty;
+  int size;
+} mlfq_queue_t;
+
+/**
+  A queue of waiting jobs, in the variant the scheme needs: fifo_queue for
+  FCFS and RR, sjf_queue for SJF/PSJF, pri_queue for PRI/PPRI,
+  mlfq_queue for MLFQ and cfs_queue for CFS.
+*/
+typedef struct _job_queue_t
+{
+  scheme_t type;
+  union
+  {
+    fifo_queue_t fifo;
+    sjf_queue_t sjf;
+    pri_queue_t pri;
+    mlfq_queue_t mlfq;
+    cfs_queue_t cfs;
+  };
+} job_queue_t;
+
+/**
+  The jobs of an instance, as one array per field indexed by job_id_t.
+  Scheduling decisions only touch the first group of arrays, so they stay
+  dense in cache; the fields read when a job is dispatched for the first
+  time or finishes are kept apart. A finished job's index is recycled
+  through the free list in next_free, so the table only grows to the most
+  jobs alive at once, however many pass through.
+*/
+typedef struct _job_table_t
+{
+  int *process_time;   /* time left, as of prev_time while running */
+  int *priority;
+  int *arrival_time;
+  int *prev_time;      /* when it was last dispatched */
+  int *core_id;        /* the core it last ran on, or -1 */
+  int *level;          /* its MLFQ level */
+  long long *vruntime; /* its CFS virtual runtime, as of prev_time while running */
+
+  int *pid;
+  int *running_time;
+  int *response_time;  /* -1 until it first runs */
+  job_id_t *next_free;
+
+  job_id_t capacity;
+  job_id_t free_head;
+  unsigned long allocations;
+} job_table_t;
+
+/**
+  Everything one scheduler instance works with: its job queue (or per-core
+  run queues), the metrics and core state, and its job table. For PSJF and
+  PPRI the running jobs are also kept in a heap with the preemption victim
+  on top: its entries point at running_keys[core], the key of the job on
+  each core, and running_handles[core] is each core's entry. CFS gives new
+  jobs min_vruntime, the virtual runtime of the last job it dispatched, and
+  load adds up the weights of the jobs alive. Idle cores have
+  their bit set in idle_cores, and busy_time adds up the core-time spent
+  running jobs until busy_since. Each finished job's waiting, turnaround
+  and response times are recorded in the three histograms. The counters after those are only kept
+  with SCHEDULER_STATS; waiting_area adds up the number of waiting jobs over
+  time until waiting_since. Instances share nothing, so any number of them
+  can run side by side.
+*/
+struct _scheduler_t
+{
+  job_queue_t q;
+  scheduler_metrics_t s;
+  scheduler_mlfq_t mlfq;
+  int next_boost;
+  scheduler_cfs_t cfs;
+  long long min_vruntime;
+  long long load;
+
+  priqueue_t running;
+  long long *running_keys;
+  int *running_handles;
+
+  unsigned long long *idle_cores;
+  int idle_count;
+  long long busy_time;
+  int busy_since;
+
+  queue_mode_t mode;
+  job_queue_t *run_queues;
+  unsigned long steals;
+  job_id_t *steal_buf;
+  int steal_capacity;
+  unsigned long steal_allocations;
+
+  job_table_t jobs;
+
+  histogram_t waiting_times;
+  histogram_t turnaround_times;
+  histogram_t response_times;
+
+  unsigned long preemptions;
+  unsigned long quantum_expiries;
+  unsigned long requeued_same_job;
+  int waiting;
+  int peak_waiting;
+  long long waiting_area;
+  int waiting_since;
+  unsigned long *context_switches;
+  unsigned long *migrations;
+};
+
+/**
+  The instance behind the scheduler_*() functions. Each thread has its own,
+  so threads using the scheduler_*() functions do not see each other's jobs.
+*/
+static _Thread_local scheduler_t *default_scheduler;
+
+/**
+  The sort key of a waiting SJF/PSJF job: the time it has left.
+*/
+static inline int SJF_KEY(const job_table_t *jobs, job_id_t job)
+{
+  return jobs->process_time[job];
+}
+/**
+  The sort key of a waiting PRI/PPRI job: its priority, then its arrival
+  time (never negative, so it fits in the low 32 bits).
+*/
+static inline long long PRI_KEY(const job_table_t *jobs, job_id_t job)
+{
+  return (long long)jobs->priority[job] * 4294967296LL + (unsigned int)jobs->arrival_time[job];
+}
+
+/**
+  The key of a job running on a core, the largest being the preemption
+  victim. For PSJF it is the time the job would finish: dispatched at
+  prev_time with process_time left, which does not change while it runs.
+  For MLFQ it is the job's level. For PPRI it is PRI_KEY(), so the lowest
+  priority, then latest arrival.
+*/
+static inline long long RUNNING_KEY(scheduler_t *sch, job_id_t job)
+{
+  if(sch->s.type == PSJF)
+  {
+    return (long long)sch->jobs.process_time[job] + sch->jobs.prev_time[job];
+  }
+  else if(sch->s.type == MLFQ)
+  {
+    return sch->jobs.level[job];
+  }
+  return PRI_KEY(&sch->jobs, job);
+}
+
+/**
+  The CFS weight of each priority from -20 to 19, those the Linux scheduler
+  gives nice values: each priority weighs about 1.25 times the next.
+*/
+static const int cfs_weights[40] =
+{
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+/**
+  The weight of a CFS job, from its priority clamped to -20..19.
+*/
+static inline int CFS_WEIGHT(const job_table_t *jobs, job_id_t job)
+{
+  int priority = jobs->priority[job];
+
+  return cfs_weights[(priority < -20 ? -20 : (priority > 19 ? 19 : priority)) + 20];
+}
+
+/**
+  Orders the running_keys entries largest first. Ties go to the lowest
+  core, whose entry has the lower address.
+*/
+int RUNNING_COMPARE(const void * a, const void * b)
+{
+  long long x = *(const long long *)a, y = *(const long long *)b;
+
+  if(x != y)
+  {
+    return x < y ? 1 : -1;
+  }
+  return (const long long *)a < (const long long *)b ? -1 : (a != b);
+}
+
+
+/**
+  Doubles the job table, putting the new indices on the free list lowest
+  first.
+  @return 0 on success, -1 if memory ran out
+*/
+static int job_table_grow(job_table_t *jobs)
+{
+  job_id_t capacity = jobs->capacity ? jobs->capacity * 2 : SCHEDULER_TABLE_JOBS;
+  int **fields[] = {&jobs->process_time, &jobs->priority, &jobs->arrival_time, &jobs->prev_time,
+                    &jobs->core_id, &jobs->level, &jobs->pid, &jobs->running_time, &jobs->response_time};
+
+  for(size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+  {
+    int *field = realloc(*fields[i], capacity * sizeof(int));
+    if(field == NULL)
+    {
+      return -1;
+    }
+    *fields[i] = field;
+    jobs->allocations++;
+  }
+  long long *vruntime = realloc(jobs->vruntime, capacity * sizeof(long long));
+  if(vruntime == NULL)
+  {
+    return -1;
+  }
+  jobs->vruntime = vruntime;
+  jobs->allocations++;
+  job_id_t *next_free = realloc(jobs->next_free, capacity * sizeof(job_id_t));
+  if(next_free == NULL)
+  {
+    return -1;
+  }
+  jobs->next_free = next_free;
+  jobs->allocations++;
+
+  for(job_id_t job = capacity; job-- > jobs->capacity; )
+  {
+    jobs->next_free[job] = jobs->free_head;
+    jobs->free_head = job;
+  }
+  jobs->capacity = capacity;
+  return 0;
+}
+
+job_id_t job_alloc(job_table_t *jobs)
+{
+  if(jobs->free_head == NO_JOB && job_table_grow(jobs) != 0)
+  {
+    return NO_JOB;
+  }
+
+  job_id_t job = jobs->free_head;
+  jobs->free_head = jobs->next_free[job];
+  return job;
+}
+void job_free(job_table_t *jobs, job_id_t job)
+{
+  jobs->next_free[job] = jobs->free_head;
+  jobs->free_head = job;
+}
+void job_table_destroy(job_table_t *jobs)
+{
+  free(jobs->process_time);
+  free(jobs->priority);
+  free(jobs->arrival_time);
+  free(jobs->prev_time);
+  free(jobs->core_id);
+  free(jobs->level);
+  free(jobs->vruntime);
+  free(jobs->pid);
+  free(jobs->running_time);
+  free(jobs->response_time);
+  free(jobs->next_free);
+}
+
+
+/**
+  Records that delta jobs started (positive) or stopped (negative) waiting
+  at time, for the peak and mean queue depth.
+*/
+static inline void count_waiting(scheduler_t *sch, int time, int delta)
+{
+#if SCHEDULER_STATS
+  sch->waiting_area += (long long)sch->waiting * (time - sch->waiting_since);
+  sch->waiting_since = time;
+  sch->waiting += delta;
+  if(sch->waiting > sch->peak_waiting)
+  {
+    sch->peak_waiting = sch->waiting;
+  }
+#endif
+}
+
+
+/**
+  Queues a job at the back of its level.
+*/
+static inline int mlfq_offer(scheduler_t *sch, mlfq_queue_t *q, job_id_t job)
+{
+  int level = sch->jobs.level[job];
+
+  q->nonempty |= 1U << level;
+  q->size++;
+  return fifo_queue_offer(&q->levels[level], job);
+}
+
+/**
+  Takes the oldest job of the highest level that has one.
+*/
+static inline job_id_t mlfq_poll(mlfq_queue_t *q)
+{
+  if(q->nonempty == 0)
+  {
+    return NO_JOB;
+  }
+
+  int level = __builtin_ctz(q->nonempty);
+  job_id_t job = fifo_queue_poll(&q->levels[level]);
+  if(fifo_queue_size(&q->levels[level]) == 0)
+  {
+    q->nonempty &= ~(1U << level);
+  }
+  q->size--;
+  return job;
+}
+
+/**
+  Returns the job at index in run order: level by level, oldest first.
+*/
+job_id_t mlfq_at(mlfq_queue_t *q, int index)
+{
+  for(int level = 0; level < q->num_levels; level++)
+  {
+    int size = fifo_queue_size(&q->levels[level]);
+    if(index < size)
+    {
+      return fifo_queue_at(&q->levels[level], index);
+    }
+    index -= size;
+  }
+  return NO_JOB;
+}
+
+/**
+  Keeps the first size jobs in run order, dropping the newest jobs of the
+  lowest levels.
+*/
+void mlfq_truncate(mlfq_queue_t *q, int size)
+{
+  q->size = 0;
+  for(int level = 0; level < q->num_levels; level++)
+  {
+    int keep = size - q->size;
+    fifo_queue_truncate(&q->levels[level], keep > 0 ? keep : 0);
+    if(fifo_queue_size(&q->levels[level]) == 0)
+    {
+      q->nonempty &= ~(1U << level);
+    }
+    q->size += fifo_queue_size(&q->levels[level]);
+  }
+}
+
+/**
+  Moves every job below level 0 to the back of level 0, the higher levels
+  first and each level oldest first.
+*/
+void mlfq_boost_queue(scheduler_t *sch, mlfq_queue_t *q)
+{
+  job_id_t job;
+
+  for(int level = 1; level < q->num_levels; level++)
+  {
+    while((job = fifo_queue_poll(&q->levels[level])) != NO_JOB)
+    {
+      sch->jobs.level[job] = 0;
+      fifo_queue_offer(&q->levels[0], job);
+    }
+  }
+  q->nonempty = q->size > 0 ? 1U : 0U;
+}
+
+/**
+  Sets up a queue in the variant the instance's scheme needs. Returns 0, or
+  -1 if memory ran out; the queue can still be passed to queue_destroy().
+*/
+int queue_init(scheduler_t *sch, job_queue_t *q)
+{
+  q->type = sch->s.type;
+  if (q->type == SJF || q->type == PSJF)
+  {
+    sjf_queue_init(&q->sjf);
+  }
+  else if (q->type == PRI || q->type == PPRI)
+  {
+    pri_queue_init(&q->pri);
+  }
+  else if (q->type == MLFQ)
+  {
+    q->mlfq.num_levels = sch->mlfq.levels;
+    q->mlfq.levels = malloc(sch->mlfq.levels * sizeof(fifo_queue_t));
+    q->mlfq.nonempty = 0;
+    q->mlfq.size = 0;
+    if (q->mlfq.levels == NULL)
+    {
+      q->mlfq.num_levels = 0;
+      return -1;
+    }
+    for (int level = 0; level < sch->mlfq.levels; level++)
+    {
+      fifo_queue_init(&q->mlfq.levels[level]);
+    }
+  }
+  else if (q->type == CFS)
+  {
+    cfs_queue_init(&q->cfs);
+  }
+  else
+  {
+    fifo_queue_init(&q->fifo);
+  }
+  return 0;
+}
+
+/**
+  Queues a job, keyed as its scheme orders it.
+*/
+static inline int queue_offer(scheduler_t *sch, job_queue_t *q, job_id_t job)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_offer(&q->sjf, SJF_KEY(&sch->jobs, job), job);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_offer(&q->pri, PRI_KEY(&sch->jobs, job), job);
+  }
+  else if(q->type == MLFQ)
+  {
+    return mlfq_offer(sch, &q->mlfq, job);
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_offer(&q->cfs, sch->jobs.vruntime[job], job);
+  }
+  return fifo_queue_offer(&q->fifo, job);
+}
+
+/**
+  Takes the job that is next to run, or NO_JOB if the queue is empty.
+*/
+static inline job_id_t queue_poll(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_poll(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_poll(&q->pri);
+  }
+  else if(q->type == MLFQ)
+  {
+    return mlfq_poll(&q->mlfq);
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_poll(&q->cfs);
+  }
+  return fifo_queue_poll(&q->fifo);
+}
+
+static inline int queue_size(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_size(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_size(&q->pri);
+  }
+  else if(q->type == MLFQ)
+  {
+    return q->mlfq.size;
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_size(&q->cfs);
+  }
+  return fifo_queue_size(&q->fifo);
+}
+
+/**
+  Puts the queue in the order its jobs will run in, so queue_at() can walk
+  it. A FIFO, and so MLFQ, is always in that order; the CFS tree and the
+  PRI/PPRI buckets are too, but list their jobs for queue_at(). The order is
+  kept until a job is offered or polled, so dumping an unchanged queue again
+  costs nothing.
+*/
+void queue_sort(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    sjf_queue_sort(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    pri_queue_sort(&q->pri);
+  }
+  else if(q->type == CFS)
+  {
+    cfs_queue_sort(&q->cfs);
+  }
+}
+
+/**
+  Returns the job at index in run order. Only valid after queue_sort().
+*/
+job_id_t queue_at(job_queue_t *q, int index)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_at(&q->sjf, index);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_at(&q->pri, index);
+  }
+  else if(q->type == MLFQ)
+  {
+    return mlfq_at(&q->mlfq, index);
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_at(&q->cfs, index);
+  }
+  return fifo_queue_at(&q->fifo, index);
+}
+
+/**
+  Drops the jobs from index size on in run order. Only valid after
+  queue_sort().
+*/
+void queue_truncate(job_queue_t *q, int size)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    sjf_queue_truncate(&q->sjf, size);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    pri_queue_truncate(&q->pri, size);
+  }
+  else if(q->type == MLFQ)
+  {
+    mlfq_truncate(&q->mlfq, size);
+  }
+  else if(q->type == CFS)
+  {
+    cfs_queue_truncate(&q->cfs, size);
+  }
+  else
+  {
+    fifo_queue_truncate(&q->fifo, size);
+  }
+}
+
+unsigned long queue_comparisons(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_comparisons(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_comparisons(&q->pri);
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_comparisons(&q->cfs);
+  }
+  return 0;
+}
+
+unsigned long queue_allocations(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    return sjf_queue_allocations(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    return pri_queue_allocations(&q->pri);
+  }
+  else if(q->type == MLFQ)
+  {
+    unsigned long allocations = 0;
+    for(int level = 0; level < q->mlfq.num_levels; level++)
+    {
+      allocations += fifo_queue_allocations(&q->mlfq.levels[level]);
+    }
+    return allocations;
+  }
+  else if(q->type == CFS)
+  {
+    return cfs_queue_allocations(&q->cfs);
+  }
+  return fifo_queue_allocations(&q->fifo);
+}
+
+void queue_destroy(job_queue_t *q)
+{
+  if(q->type == SJF || q->type == PSJF)
+  {
+    sjf_queue_destroy(&q->sjf);
+  }
+  else if(q->type == PRI || q->type == PPRI)
+  {
+    pri_queue_destroy(&q->pri);
+  }
+  else if(q->type == MLFQ)
+  {
+    for(int level = 0; level < q->mlfq.num_levels; level++)
+    {
+      fifo_queue_destroy(&q->mlfq.levels[level]);
+    }
+    free(q->mlfq.levels);
+  }
+  else if(q->type == CFS)
+  {
+    cfs_queue_destroy(&q->cfs);
+  }
+  else
+  {
+    fifo_queue_destroy(&q->fifo);
+  }
+}
+
+/**
+  Returns the queue a core takes its next job from, and puts preempted jobs back into.
+*/
+job_queue_t *core_queue(scheduler_t *sch, int core_id)
+{
+  if(sch->mode == QUEUE_GLOBAL)
+  {
+    return &sch->q;
+  }
+  return &sch->run_queues[core_id];
+}
+
+/**
+  Returns the queue an arriving job waits in: the shared queue, or the
+  shortest run queue (the lowest core id on ties).
+*/
+job_queue_t *arrival_queue(scheduler_t *sch)
+{
+  if(sch->mode == QUEUE_GLOBAL)
+  {
+    return &sch->q;
+  }
+
+  job_queue_t *shortest = &sch->run_queues[0];
+  for(int i = 1; i < sch->s.num_cores; i++)
+  {
+    if(queue_size(&sch->run_queues[i]) < queue_size(shortest))
+    {
+      shortest = &sch->run_queues[i];
+    }
+  }
+  return shortest;
+}
+
+/**
+  Refills the empty run queue of core_id from the longest other run queue.
+  With QUEUE_STEAL_TAIL_HALF the last half of that queue in run order is
+  taken and re-queued in that order, so jobs that tie keep their order. The
+  SJF/PSJF heap selects that half rather than sorting; the other queues list
+  it without comparing jobs, apart from the PRI/PPRI overflow heap.
+*/
+void steal_jobs(scheduler_t *sch, int core_id)
+{
+  job_queue_t *local = &sch->run_queues[core_id];
+  job_queue_t *victim = NULL;
+
+  for(int i = 0; i < sch->s.num_cores; i++)
+  {
+    if(i != core_id && queue_size(&sch->run_queues[i]) > 0 &&
+       (victim == NULL || queue_size(&sch->run_queues[i]) > queue_size(victim)))
+    {
+      victim = &sch->run_queues[i];
+    }
+  }
+  if(victim == NULL)
+  {
+    return;
+  }
+  sch->steals++;
+
+  if(sch->mode == QUEUE_STEAL_HEAD)
+  {
+    queue_offer(sch, local, queue_poll(victim));
+    return;
+  }
+
+  int count = (queue_size(victim) + 1) / 2;
+  if(victim->type == SJF || victim->type == PSJF)
+  {
+    if(sjf_queue_split(&victim->sjf, &local->sjf, count) < 0)
+    {
+      queue_offer(sch, local, queue_poll(victim));
+    }
+    return;
+  }
+  if(count > sch->steal_capacity)
+  {
+    job_id_t *buf = realloc(sch->steal_buf, count * sizeof(job_id_t));
+    if(buf == NULL)
+    {
+      queue_offer(sch, local, queue_poll(victim));
+      return;
+    }
+    sch->steal_buf = buf;
+    sch->steal_capacity = count;
+    sch->steal_allocations++;
+  }
+
+  int keep = queue_size(victim) - count;
+  queue_sort(victim);
+  if(queue_at(victim, keep) == NO_JOB)
+  {
+    queue_offer(sch, local, queue_poll(victim));
+    return;
+  }
+  for(int i = 0; i < count; i++)
+  {
+    sch->steal_buf[i] = queue_at(victim, keep + i);
+  }
+  queue_truncate(victim, keep);
+  for(int i = 0; i < count; i++)
+  {
+    queue_offer(sch, local, sch->steal_buf[i]);
+  }
+}
+
+/**
+  Returns the lowest idle core, or -1 if every core is busy.
+*/
+int first_idle_core(scheduler_t *sch)
+{
+  int words = (sch->s.num_cores + SCHEDULER_CORE_WORD_BITS - 1) / SCHEDULER_CORE_WORD_BITS;
+
+  for(int w = 0; w < words; w++)
+  {
+    if(sch->idle_cores[w] != 0)
+    {
+      return w * SCHEDULER_CORE_WORD_BITS + __builtin_ctzll(sch->idle_cores[w]);
+    }
+  }
+  return -1;
+}
+
+/**
+  Puts job (NO_JOB to leave the core idle) on core_id at time, replacing
+  whatever ran there, and keeps the heap of running jobs and the idle-core
+  bitmap in step.
+*/
+void core_dispatch(scheduler_t *sch, int core_id, job_id_t job, int time)
+{
+  unsigned long long bit = 1ULL << (core_id % SCHEDULER_CORE_WORD_BITS);
+  unsigned long long *word = &sch->idle_cores[core_id / SCHEDULER_CORE_WORD_BITS];
+
+  // Add up the busy core-time before the number of busy cores changes
+  sch->busy_time += (long long)(sch->s.num_cores - sch->idle_count) * (time - sch->busy_since);
+  sch->busy_since = time;
+
+  if(job == NO_JOB && !(*word & bit))
+  {
+    *word |= bit;
+    sch->idle_count++;
+  }
+  else if(job != NO_JOB && (*word & bit))
+  {
+    *word &= ~bit;
+    sch->idle_count--;
+  }
+
+  if(sch->running_handles != NULL && sch->running_handles[core_id] != -1)
+  {
+    priqueue_remove_handle(&sch->running, sch->running_handles[core_id]);
+    sch->running_handles[core_id] = -1;
+  }
+
+#if SCHEDULER_STATS
+  if(job != NO_JOB && job != sch->s.core_arr[core_id])
+  {
+    sch->context_switches[core_id]++;
+    if(sch->jobs.core_id[job] != -1 && sch->jobs.core_id[job] != core_id)
+    {
+      sch->migrations[core_id]++;
+    }
+  }
+#endif
+
+  sch->s.core_arr[core_id] = job;
+  if(job == NO_JOB)
+  {
+    return;
+  }
+
+  sch->jobs.core_id[job] = core_id;
+  sch->jobs.prev_time[job] = time;
+  if(sch->running_handles != NULL)
+  {
+    sch->running_keys[core_id] = RUNNING_KEY(sch, job);
+    sch->running_handles[core_id] = priqueue_offer_handle(&sch->running, &sch->running_keys[core_id]);
+  }
+}
+
+/**
+  Takes the next job for core_id from its queue at time, stealing first if
+  the core's own run queue is empty.
+  @return the job, or NO_JOB if no job is waiting anywhere
+*/
+job_id_t next_job(scheduler_t *sch, int core_id, int time)
+{
+  job_queue_t *q = core_queue(sch, core_id);
+
+  if(sch->mode != QUEUE_GLOBAL && queue_size(q) == 0)
+  {
+    steal_jobs(sch, core_id);
+  }
+
+  job_id_t job = queue_poll(q);
+  if(job != NO_JOB)
+  {
+    count_waiting(sch, time, -1);
+    if(sch->s.type == CFS && sch->jobs.vruntime[job] > sch->min_vruntime)
+    {
+      sch->min_vruntime = sch->jobs.vruntime[job];
+    }
+  }
+  return job;
+}
+
+/**
+  Moves every MLFQ job, waiting or running, back to level 0 if a boost is
+  due by time. Boosts are only applied when the scheduler is next called:
+  until then no job is picked, so nothing can tell them apart from boosts
+  made on the dot.
+*/
+void mlfq_boost(scheduler_t *sch, int time)
 {
-	return (1);
+  if(sch->mlfq.boost_interval <= 0 || time < sch->next_boost)
+  {
+    return;
+  }
+  sch->next_boost = time - time % sch->mlfq.boost_interval + sch->mlfq.boost_interval;
+
+  mlfq_boost_queue(sch, &sch->q.mlfq);
+  if(sch->run_queues != NULL)
+  {
+    for(int i = 0; i < sch->s.num_cores; i++)
+    {
+      mlfq_boost_queue(sch, &sch->run_queues[i].mlfq);
+    }
+  }
+
+  for(int i = 0; i < sch->s.num_cores; i++)
+  {
+    job_id_t job = sch->s.core_arr[i];
+    if(job != NO_JOB && sch->jobs.level[job] != 0)
+    {
+      sch->jobs.level[job] = 0;
+      priqueue_remove_handle(&sch->running, sch->running_handles[i]);
+      sch->running_keys[i] = 0;
+      sch->running_handles[i] = priqueue_offer_handle(&sch->running, &sch->running_keys[i]);
+    }
+  }
 }
-int SJF_COMPARE(const void * a, const void * b)
+
+/**
+  Adds the time a CFS job has run since it was dispatched to its virtual
+  runtime, scaled down by its weight.
+*/
+static inline void cfs_charge(scheduler_t *sch, job_id_t job, int time)
 {
-	return ( (*(job_t*)a).process_time - (*(job_t*)b).process_time );
+  sch->jobs.vruntime[job] += (long long)(time - sch->jobs.prev_time[job]) *
+                             SCHEDULER_CFS_WEIGHT_0 * SCHEDULER_CFS_WEIGHT_0 / CFS_WEIGHT(&sch->jobs, job);
 }
-int PRI_COMPARE(const void * a, const void * b)
+
+
+/**
+  Does the work of sched_create_queues(), sched_create_mlfq() and
+  sched_create_cfs(); mlfq is only used by MLFQ and cfs by CFS.
+*/
+scheduler_t *sched_create_scheme(int cores, scheme_t scheme, queue_mode_t mode, const scheduler_mlfq_t *mlfq,
+                                 const scheduler_cfs_t *cfs)
 {
-  int compare = ( (*(job_t*)a).priority - (*(job_t*)b).priority );
+  scheduler_t *sch = malloc(sizeof(scheduler_t));
+  if(sch == NULL)
+  {
+    return NULL;
+  }
+
+  sch->s.type = scheme;
+  sch->mlfq = *mlfq;
+  sch->next_boost = mlfq->boost_interval;
+  sch->cfs = *cfs;
+  sch->min_vruntime = 0;
+  sch->load = 0;
+
+  sch->s.num_cores = cores;
+  histogram_init(&sch->waiting_times);
+  histogram_init(&sch->turnaround_times);
+  histogram_init(&sch->response_times);
 
-  if(compare == 0)
+  sch->s.num_jobs = 0;
+
+  sch->s.core_arr = malloc(cores * sizeof(unsigned int));
+  memset(&sch->jobs, 0, sizeof(job_table_t));
+  sch->jobs.free_head = NO_JOB;
+
+  sch->mode = mode;
+  sch->run_queues = NULL;
+  sch->steals = 0;
+  sch->steal_buf = NULL;
+  sch->steal_capacity = 0;
+  sch->steal_allocations = 0;
+
+  sch->preemptions = 0;
+  sch->quantum_expiries = 0;
+  sch->requeued_same_job = 0;
+  sch->waiting = 0;
+  sch->peak_waiting = 0;
+  sch->waiting_area = 0;
+  sch->waiting_since = 0;
+  sch->context_switches = calloc(cores, sizeof(unsigned long));
+  sch->migrations = calloc(cores, sizeof(unsigned long));
+
+  int words = (cores + SCHEDULER_CORE_WORD_BITS - 1) / SCHEDULER_CORE_WORD_BITS;
+  sch->idle_cores = calloc(words, sizeof(unsigned long long));
+  sch->idle_count = cores;
+  sch->busy_time = 0;
+  sch->busy_since = 0;
+
+  // Everything is allocated before it is filled in, so sched_destroy() can
+  // release whatever was allocated if something ran out
+  int i, failed = 0;
+  sch->running_keys = NULL;
+  sch->running_handles = NULL;
+  if (scheme == PSJF || scheme == PPRI || scheme == MLFQ)
   {
-    return (*(job_t *)a).arrival_time - (*(job_t *)b).arrival_time;
+    failed |= priqueue_init_heap(&sch->running, RUNNING_COMPARE, SCHEDULER_HEAP_ARITY) != 0;
+    sch->running_keys = malloc(cores * sizeof(long long));
+    sch->running_handles = malloc(cores * sizeof(int));
+    failed |= sch->running_keys == NULL || sch->running_handles == NULL;
+  }
 
+  failed |= queue_init(sch, &sch->q) != 0;
+  if (mode != QUEUE_GLOBAL)
+  {
+    sch->run_queues = malloc(cores * sizeof(job_queue_t));
+    for (i = 0; sch->run_queues != NULL && i < cores; i++)
+    {
+      failed |= queue_init(sch, &sch->run_queues[i]) != 0;
+    }
+    failed |= sch->run_queues == NULL;
   }
-  else
+
+  if (failed || sch->s.core_arr == NULL || sch->context_switches == NULL || sch->migrations == NULL ||
+      sch->idle_cores == NULL)
   {
-    return(compare);
+    sched_destroy(sch);
+    return NULL;
+  }
 
+  for (i = 0; i < cores; i++)
+  {
+    sch->s.core_arr[i] = NO_JOB;
+    sch->idle_cores[i / SCHEDULER_CORE_WORD_BITS] |= 1ULL << (i % SCHEDULER_CORE_WORD_BITS);
+  }
+  if (sch->running_handles != NULL)
+  {
+    for (i = 0; i < cores; i++)
+    {
+      sch->running_handles[i] = -1;
+    }
   }
+  return sch;
 }
 
 
 /**
-  Initalizes the scheduler.
-  Assumptions:DIAGRAM:at cores is a positive, non-zero number.
+  Creates an independent scheduler instance with one queue shared by all cores.
+  Assumptions:
+    - You may assume that cores is a positive, non-zero number.
     - You may assume that scheme is a valid scheduling scheme.
   @param cores the number of cores that is available by the scheduler. These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
-  @param scheme  the scheduling scheme that should be used. This value will be one of the six enum values of scheme_t
+  @param scheme  the scheduling scheme that should be used. This value will be one of the enum values of scheme_t; MLFQ gets sched_mlfq_defaults() for SCHEDULER_MLFQ_LEVELS levels from a quantum of SCHEDULER_MLFQ_QUANTUM, and CFS sched_cfs_defaults() for SCHEDULER_CFS_LATENCY
+  @return the new instance, to be released with sched_destroy()
+  @return NULL if memory ran out
 */
-void scheduler_start_up(int cores, scheme_t scheme)
+scheduler_t *sched_create(int cores, scheme_t scheme)
 {
-  s.type = scheme;
+  return sched_create_queues(cores, scheme, QUEUE_GLOBAL);
+}
+
 
-  s.num_cores = cores;
-  s.turnaround_time = 0.0;
-  s.wait_time = 0.0;
-  s.response_time = 0.0;
+/**
+  Creates an independent scheduler instance queuing waiting jobs as mode
+  says. Jobs only ever wait while no core is idle, whatever the mode.
+  @param cores the number of cores that is available by the scheduler.
+  @param scheme the scheduling scheme that should be used; MLFQ and CFS get their default parameters (see sched_create_mlfq() and sched_create_cfs())
+  @param mode one shared queue, or per-core run queues and how idle cores steal
+  @return the new instance, to be released with sched_destroy()
+  @return NULL if memory ran out
+*/
+scheduler_t *sched_create_queues(int cores, scheme_t scheme, queue_mode_t mode)
+{
+  scheduler_mlfq_t mlfq;
+  scheduler_cfs_t cfs;
 
-  s.num_jobs = 0;
+  sched_mlfq_defaults(&mlfq, SCHEDULER_MLFQ_LEVELS, SCHEDULER_MLFQ_QUANTUM);
+  sched_cfs_defaults(&cfs, SCHEDULER_CFS_LATENCY);
+  return sched_create_scheme(cores, scheme, mode, &mlfq, &cfs);
+}
 
-  s.core_arr = malloc(cores * sizeof(job_t));
 
-  int i;
-  for (i = 0; i < cores; i++)
+/**
+  Creates an independent MLFQ scheduler instance.
+  @param cores the number of cores that is available by the scheduler.
+  @param mode one shared queue, or per-core run queues and how idle cores steal
+  @param mlfq the levels, their quanta and how often jobs are boosted
+  @return the new instance, to be released with sched_destroy()
+  @return NULL if memory ran out or mlfq does not have 1 to SCHEDULER_MLFQ_MAX_LEVELS levels with positive quanta
+*/
+scheduler_t *sched_create_mlfq(int cores, queue_mode_t mode, const scheduler_mlfq_t *mlfq)
+{
+  if(mlfq->levels < 1 || mlfq->levels > SCHEDULER_MLFQ_MAX_LEVELS)
   {
-    s.core_arr[i] = NULL;
+    return NULL;
   }
-
-  if (s.type == FCFS || s.type == RR)
+  for(int level = 0; level < mlfq->levels; level++)
   {
-    priqueue_init(&q, FCFS_COMPARE);
+    if(mlfq->quanta[level] <= 0)
+    {
+      return NULL;
+    }
   }
-  else if (s.type == SJF || s.type == PSJF)
+  scheduler_cfs_t cfs;
+
+  sched_cfs_defaults(&cfs, SCHEDULER_CFS_LATENCY);
+  return sched_create_scheme(cores, MLFQ, mode, mlfq, &cfs);
+}
+
+
+/**
+  Fills in MLFQ parameters with the given number of levels, quanta doubling
+  from quantum at level 0 down, and a boost every SCHEDULER_MLFQ_BOOST_QUANTA
+  times the quantum of the lowest level.
+  @param mlfq the parameters to fill in
+  @param levels the number of levels, from 1 to SCHEDULER_MLFQ_MAX_LEVELS
+  @param quantum the quantum of level 0
+*/
+void sched_mlfq_defaults(scheduler_mlfq_t *mlfq, int levels, int quantum)
+{
+  mlfq->levels = levels;
+  for(int level = 0; level < SCHEDULER_MLFQ_MAX_LEVELS; level++)
   {
-    priqueue_init(&q, SJF_COMPARE);
+    mlfq->quanta[level] = level < levels ? quantum << level : 0;
   }
-  else if (s.type == PRI || s.type == PPRI)
+  mlfq->boost_interval = levels > 0 ? SCHEDULER_MLFQ_BOOST_QUANTA * mlfq->quanta[levels - 1] : 0;
+}
+
+
+/**
+  Creates an independent CFS scheduler instance.
+  @param cores the number of cores that is available by the scheduler.
+  @param mode one shared queue, or per-core run queues and how idle cores steal
+  @param cfs the target latency and shortest time slice
+  @return the new instance, to be released with sched_destroy()
+  @return NULL if memory ran out or cfs does not have a positive latency and minimum granularity
+*/
+scheduler_t *sched_create_cfs(int cores, queue_mode_t mode, const scheduler_cfs_t *cfs)
+{
+  if(cfs->latency <= 0 || cfs->min_granularity <= 0)
   {
-    priqueue_init(&q, PRI_COMPARE);
+    return NULL;
   }
+
+  scheduler_mlfq_t mlfq;
+
+  sched_mlfq_defaults(&mlfq, SCHEDULER_MLFQ_LEVELS, SCHEDULER_MLFQ_QUANTUM);
+  return sched_create_scheme(cores, CFS, mode, &mlfq, cfs);
+}
+
+
+/**
+  Fills in CFS parameters with the given target latency, and a minimum
+  granularity of SCHEDULER_CFS_SLICES times less (at least 1).
+  @param cfs the parameters to fill in
+  @param latency the target latency
+*/
+void sched_cfs_defaults(scheduler_cfs_t *cfs, int latency)
+{
+  cfs->latency = latency;
+  cfs->min_granularity = latency / SCHEDULER_CFS_SLICES > 0 ? latency / SCHEDULER_CFS_SLICES : 1;
+}
+
+
+/**
+  Initalizes the scheduler.
+  Assumptions:DIAGRAM:at cores is a positive, non-zero number.
+    - You may assume that scheme is a valid scheduling scheme.
+  @param cores the number of cores that is available by the scheduler. These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
+  @param scheme  the scheduling scheme that should be used. This value will be one of the enum values of scheme_t; MLFQ gets sched_mlfq_defaults() for SCHEDULER_MLFQ_LEVELS levels from a quantum of SCHEDULER_MLFQ_QUANTUM, and CFS sched_cfs_defaults() for SCHEDULER_CFS_LATENCY
+*/
+void scheduler_start_up(int cores, scheme_t scheme)
+{
+  default_scheduler = sched_create(cores, scheme);
 }
 
 
@@ -96,129 +1197,145 @@ void scheduler_start_up(int cores, scheme_t scheme)
   this will preempt the currently running job.
   Assumptions:
     - You may assume that every job wil have a unique arrival time.
+  @param sch the scheduler instance
   @param job_number a globally unique identification number of the job arriving.
   @param time the current time of the simulator.
   @param running_time the total number of time units this job will run before it will be finished.
   @param priority the priority of the job. (The lower the value, the higher the priority.)
   @return index of core job should be scheduled on
   @return -1 if no scheduling changes should be made.
+  @return SCHEDULER_NO_MEMORY if the job table could not grow to take the job.
  */
-void longest_time_search(int time)
+void longest_time_search(scheduler_t *sch, int time)
 {
-	s.longest_time = -1;
-	s.longest_index = -1;
-	for(int i = 0; i < s.num_cores; i ++)
-	{
-		s.core_arr[i]->process_time = s.core_arr[i]->process_time - (time - s.core_arr[i]->prev_time);
-		s.core_arr[i]->prev_time = time;
+	int core = (long long *)priqueue_peek(&sch->running) - sch->running_keys;
+	job_id_t victim = sch->s.core_arr[core];
 
-		if(s.core_arr[i]->process_time > s.longest_time)
-		{
-			s.longest_time = s.core_arr[i]->process_time;
-			s.longest_index = i;
-		}
-	}
+	sch->s.longest_time = sch->jobs.process_time[victim] - (time - sch->jobs.prev_time[victim]);
+	sch->s.longest_index = core;
 }
-void lowest_priority_search(int time)
+void lowest_priority_search(scheduler_t *sch)
 {
-	s.lowest_priority = s.core_arr[0]->priority;
-	s.lowest_core = 0;
-	for(int i =0; i < s.num_cores; i++)
-	{
+	int core = (long long *)priqueue_peek(&sch->running) - sch->running_keys;
 
-		if(s.core_arr[i]->priority > s.lowest_priority)
-		{
-			 s.lowest_priority = s.core_arr[i]->priority;
-			 s.lowest_core = i;
-		}
-		else if(s.core_arr[i]->priority == s.lowest_priority)
-		{
-			if(s.core_arr[i]->arrival_time > s.core_arr[s.lowest_core]->arrival_time)
-			{
-			 s.lowest_core = i;
-			}
-		}
-	}
+	sch->s.lowest_priority = sch->jobs.priority[sch->s.core_arr[core]];
+	sch->s.lowest_core = core;
 }
-int scheduler_new_job(int job_number, int time, int running_time, int priority)
+int sched_new_job(scheduler_t *sch, int job_number, int time, int running_time, int priority)
 {
+	job_table_t *jobs = &sch->jobs;
 
-	job_t *new_job = malloc(s.num_cores * sizeof(job_t));
-	new_job->pid = job_number;
-	new_job->running_time = running_time;
-	new_job->process_time = running_time;
-	new_job->arrival_time = time;
-	new_job->priority = priority;
-	new_job->jresponse_time = 0;
-	new_job->jresponse_time = -1;
+	if(sch->s.type == MLFQ)
+	{
+		mlfq_boost(sch, time);
+	}
 
-  int idle_core;
-  for(int i = 0; i < s.num_cores; i++)
-  {
-    if(s.core_arr[i] == NULL)
-    {
-      idle_core = i;
-			break;
-    }
-    else
-    {
-      idle_core = -1;
-    }
-  }
+	job_id_t new_job = job_alloc(jobs);
+	if(new_job == NO_JOB)
+	{
+		return SCHEDULER_NO_MEMORY;
+	}
+	jobs->pid[new_job] = job_number;
+	jobs->running_time[new_job] = running_time;
+	jobs->process_time[new_job] = running_time;
+	jobs->arrival_time[new_job] = time;
+	jobs->priority[new_job] = priority;
+	jobs->response_time[new_job] = -1;
+	jobs->core_id[new_job] = -1;
+	jobs->level[new_job] = 0;
+	jobs->vruntime[new_job] = sch->min_vruntime;
+	if(sch->s.type == CFS)
+	{
+		sch->load += CFS_WEIGHT(jobs, new_job);
+	}
+
+  int idle_core = first_idle_core(sch);
   if(idle_core >= 0)
   {
-		s.core_arr[idle_core] = new_job;
-		s.core_arr[idle_core]->jresponse_time = time - s.core_arr[idle_core]->arrival_time;
-		if(s.type == PSJF)
-		{
-			s.core_arr[idle_core]->prev_time = time;
-		}
+		core_dispatch(sch, idle_core, new_job, time);
+		jobs->response_time[new_job] = time - jobs->arrival_time[new_job];
 		return(idle_core);
   }
-  else if(s.type == PSJF)
+  else if(sch->s.type == PSJF)
   {
 
-		longest_time_search(time);
-		if(new_job->process_time < s.longest_time)
+		longest_time_search(sch, time);
+		if(jobs->process_time[new_job] < sch->s.longest_time)
 		{
-			if(s.core_arr[s.longest_index]->jresponse_time == (time - s.core_arr[s.longest_index]->arrival_time))
+			job_id_t victim = sch->s.core_arr[sch->s.longest_index];
+			if(jobs->response_time[victim] == (time - jobs->arrival_time[victim]))
 			{
-				s.core_arr[s.longest_index]->jresponse_time = -1;
+				jobs->response_time[victim] = -1;
 			}
-			priqueue_offer(&q, s.core_arr[s.longest_index]);
-			s.core_arr[s.longest_index] = new_job;
-			if(new_job->jresponse_time == -1)
+			// The victim's remaining time is only worked out now, when it goes back to the queue
+			jobs->process_time[victim] = sch->s.longest_time;
+			queue_offer(sch, core_queue(sch, sch->s.longest_index), victim);
+			count_waiting(sch, time, 1);
+#if SCHEDULER_STATS
+			sch->preemptions++;
+#endif
+			core_dispatch(sch, sch->s.longest_index, new_job, time);
+			if(jobs->response_time[new_job] == -1)
 			{
-				new_job->jresponse_time = time - s.core_arr[s.longest_index]->arrival_time;
+				jobs->response_time[new_job] = time - jobs->arrival_time[new_job];
 			}
 
-			return(s.longest_index);
+			return(sch->s.longest_index);
 		}
   }
-  else if(s.type == PPRI)
+  else if(sch->s.type == PPRI)
   {
 
-		lowest_priority_search(time);
-	  if(new_job->priority < s.lowest_priority)
+		lowest_priority_search(sch);
+	  if(jobs->priority[new_job] < sch->s.lowest_priority)
 	  {
-
-	   if(s.core_arr[s.lowest_core]->jresponse_time == time - s.core_arr[s.lowest_core]->arrival_time)
+	   job_id_t victim = sch->s.core_arr[sch->s.lowest_core];
+	   if(jobs->response_time[victim] == time - jobs->arrival_time[victim])
 	   {
-	     s.core_arr[s.lowest_core]->jresponse_time = -1;
+	     jobs->response_time[victim] = -1;
 	   }
-     priqueue_offer(&q, s.core_arr[s.lowest_core]);
-     s.core_arr[s.lowest_core] = new_job;
-     if(s.core_arr[s.lowest_core]->jresponse_time == -1)
+     queue_offer(sch, core_queue(sch, sch->s.lowest_core), victim);
+     count_waiting(sch, time, 1);
+#if SCHEDULER_STATS
+     sch->preemptions++;
+#endif
+     core_dispatch(sch, sch->s.lowest_core, new_job, time);
+     if(jobs->response_time[new_job] == -1)
      {
-      s.core_arr[s.lowest_core]->jresponse_time = time - s.core_arr[s.lowest_core]->arrival_time;
+      jobs->response_time[new_job] = time - jobs->arrival_time[new_job];
 	   }
 
-	    return s.lowest_core;
+	    return sch->s.lowest_core;
 	  }
 	}
-	priqueue_offer(&q, new_job);
+  else if(sch->s.type == MLFQ)
+  {
+		// Arrivals start at level 0, so they preempt the job running at the lowest level below it
+		int core = (long long *)priqueue_peek(&sch->running) - sch->running_keys;
+		job_id_t victim = sch->s.core_arr[core];
+		if(jobs->level[victim] > 0)
+		{
+			queue_offer(sch, core_queue(sch, core), victim);
+			count_waiting(sch, time, 1);
+#if SCHEDULER_STATS
+			sch->preemptions++;
+#endif
+			core_dispatch(sch, core, new_job, time);
+			jobs->response_time[new_job] = time - jobs->arrival_time[new_job];
+			return core;
+		}
+  }
+	queue_offer(sch, arrival_queue(sch), new_job);
+	count_waiting(sch, time, 1);
 	return -1;
 }
+/**
+  Calls sched_new_job() on the instance set up by scheduler_start_up().
+ */
+int scheduler_new_job(int job_number, int time, int running_time, int priority)
+{
+	return sched_new_job(default_scheduler, job_number, time, running_time, priority);
+}
 
 
 /**
@@ -227,82 +1344,203 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
   If any job should be scheduled to run on the core free'd up by the
   finished job, return the job_number of the job that should be scheduled to
   run on core core_id.
+  @param sch the scheduler instance
   @param core_id the zero-based index of the core where the job was located.
   @param job_number a globally unique identification number of the job.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled to run on core core_id
   @return -1 if core should remain idle.
  */
-int scheduler_job_finished(int core_id, int job_number, int time)
+int sched_job_finished(scheduler_t *sch, int core_id, int job_number, int time)
 {
-	job_t *curr_job = s.core_arr[core_id];
+	job_table_t *jobs = &sch->jobs;
+	job_id_t curr_job = sch->s.core_arr[core_id];
 
-  s.wait_time += time - (curr_job->running_time) - (curr_job->arrival_time);
-  s.turnaround_time += time - (curr_job->arrival_time);
-	s.response_time += curr_job->jresponse_time;
-  s.num_jobs++;
+	// The job on the core is known already; job_number is only there for callers' convenience
+	(void)job_number;
 
+  if(sch->s.type == MLFQ)
+  {
+    mlfq_boost(sch, time);
+  }
 
-  free(curr_job);
-  curr_job = NULL;
-
-  if(priqueue_size(&q) != 0)
+  histogram_record(&sch->waiting_times, time - jobs->running_time[curr_job] - jobs->arrival_time[curr_job]);
+  histogram_record(&sch->turnaround_times, time - jobs->arrival_time[curr_job]);
+  histogram_record(&sch->response_times, jobs->response_time[curr_job]);
+  sch->s.num_jobs++;
+  if(sch->s.type == CFS)
   {
-		job_t *temp_job = (job_t*)priqueue_poll(&q);
-		if(s.type == PSJF)
-		{
-			temp_job->prev_time = time;
-		}
+    sch->load -= CFS_WEIGHT(jobs, curr_job);
+  }
 
-		if(temp_job->jresponse_time == -1)
+
+  job_id_t temp_job = next_job(sch, core_id, time);
+  core_dispatch(sch, core_id, temp_job, time);
+
+  job_free(jobs, curr_job);
+
+  if(temp_job != NO_JOB)
+  {
+		if(jobs->response_time[temp_job] == -1)
 		{
-			temp_job->jresponse_time = time - temp_job->arrival_time;
+			jobs->response_time[temp_job] = time - jobs->arrival_time[temp_job];
 		}
-		s.core_arr[core_id] = temp_job;
-		return(temp_job->pid);
+		return(jobs->pid[temp_job]);
   }
   else
   {
-		s.core_arr[core_id] = NULL;
     return(-1);
   }
 }
+/**
+  Calls sched_job_finished() on the instance set up by scheduler_start_up().
+ */
+int scheduler_job_finished(int core_id, int job_number, int time)
+{
+	return sched_job_finished(default_scheduler, core_id, job_number, time);
+}
 
 
 /**
-  When the scheme is set to RR, called when the quantum timer has expired
-  on a core.
+  When the scheme is set to RR, MLFQ or CFS, called when the quantum timer
+  has expired on a core. With MLFQ the job moves down a level.
   If any job should be scheduled to run on the core free'd up by
   the quantum expiration, return the job_number of the job that should be
   scheduled to run on core core_id.
+  @param sch the scheduler instance
   @param core_id the zero-based index of the core where the quantum has expired.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled on core cord_id
   @return -1 if core should remain idle
  */
-int scheduler_quantum_expired(int core_id, int time)
+int sched_quantum_expired(scheduler_t *sch, int core_id, int time)
 {
-	job_t* curr_job = s.core_arr[core_id];
+	job_table_t *jobs = &sch->jobs;
+	job_id_t curr_job = sch->s.core_arr[core_id];
+
+	if(sch->s.type == MLFQ)
+	{
+		mlfq_boost(sch, time);
+	}
+
+	if(curr_job != NO_JOB)
+	{
+		// An MLFQ job that used up its quantum moves down a level
+		if(sch->s.type == MLFQ && jobs->level[curr_job] < sch->mlfq.levels - 1)
+		{
+			jobs->level[curr_job]++;
+		}
+		// A CFS job goes back into the tree at the virtual runtime it has reached
+		if(sch->s.type == CFS)
+		{
+			cfs_charge(sch, curr_job, time);
+		}
+		queue_offer(sch, core_queue(sch, core_id), curr_job);
+		count_waiting(sch, time, 1);
+	}
 
-	if(curr_job == NULL)
+	core_dispatch(sch, core_id, next_job(sch, core_id, time), time);
+#if SCHEDULER_STATS
+	if(curr_job != NO_JOB)
 	{
-		if(priqueue_size(&q) == 0)
+		sch->quantum_expiries++;
+		if(sch->s.core_arr[core_id] == curr_job)
 		{
-			return -1;
+			sch->requeued_same_job++;
 		}
 	}
-	else
+#endif
+	job_id_t job = sch->s.core_arr[core_id];
+	if(job == NO_JOB)
 	{
-		priqueue_offer(&q, curr_job);
+		return -1;
 	}
 
-	s.core_arr[core_id] = priqueue_poll(&q);
-
-	if(s.core_arr[core_id]->jresponse_time == -1)
+	if(jobs->response_time[job] == -1)
 	{
-		s.core_arr[core_id]->jresponse_time = time - s.core_arr[core_id]->arrival_time;
+		jobs->response_time[job] = time - jobs->arrival_time[job];
 	}
-	return (s.core_arr[core_id]->pid);
+	return (jobs->pid[job]);
+}
+/**
+  Calls sched_quantum_expired() on the instance set up by scheduler_start_up().
+ */
+int scheduler_quantum_expired(int core_id, int time)
+{
+	return sched_quantum_expired(default_scheduler, core_id, time);
+}
+
+
+/**
+  Returns the quantum of the job the scheduler last put on a core, for
+  schemes that hand out a quantum per job: with MLFQ, the quantum of the
+  job's level; with CFS, the job's weighted share of the target latency
+  over all cores among the jobs alive now, between the minimum granularity
+  and the latency. RR's quantum is fixed by the caller.
+  @param sch the scheduler instance
+  @param core_id the zero-based index of the core
+  @return the number of time units the job may run before sched_quantum_expired() is due
+  @return -1 if the core is idle or the scheme has no such quantum
+ */
+int sched_time_slice(scheduler_t *sch, int core_id)
+{
+  job_id_t job = sch->s.core_arr[core_id];
+
+  if(job == NO_JOB)
+  {
+    return -1;
+  }
+  else if(sch->s.type == MLFQ)
+  {
+    return sch->mlfq.quanta[sch->jobs.level[job]];
+  }
+  else if(sch->s.type == CFS)
+  {
+    long long slice = (long long)sch->cfs.latency * sch->s.num_cores * CFS_WEIGHT(&sch->jobs, job) / sch->load;
+    if(slice < sch->cfs.min_granularity)
+    {
+      return sch->cfs.min_granularity;
+    }
+    return slice < sch->cfs.latency ? slice : sch->cfs.latency;
+  }
+  return -1;
+}
+
+
+/**
+  Reads the percentiles reported for one per-job time out of its histogram.
+*/
+static void latency_percentiles(const histogram_t *h, scheduler_latency_t *latency)
+{
+  latency->p50 = histogram_percentile(h, 50);
+  latency->p90 = histogram_percentile(h, 90);
+  latency->p99 = histogram_percentile(h, 99);
+  latency->p999 = histogram_percentile(h, 99.9);
+  latency->max = h->max;
+}
+
+
+/**
+  Fills in the number of finished jobs, their average waiting, turnaround
+  and response times and the p50/p90/p99/p99.9/max of each, the share of
+  core-time spent running jobs up to the last finish, and how often a core
+  stole from another run queue.
+  Assumptions:
+    - This function will only be called after all scheduling is complete (all jobs that have arrived will have finished and no new jobs will arrive).
+  @param sch the scheduler instance
+  @param summary where to store the results
+ */
+void sched_metrics(scheduler_t *sch, scheduler_summary_t *summary)
+{
+	summary->num_jobs = sch->s.num_jobs;
+	summary->average_waiting_time = (double)sch->waiting_times.sum/sch->s.num_jobs;
+	summary->average_turnaround_time = (double)sch->turnaround_times.sum/sch->s.num_jobs;
+	summary->average_response_time = (double)sch->response_times.sum/sch->s.num_jobs;
+	summary->utilization = sch->busy_since > 0 ? (float)sch->busy_time / ((float)sch->s.num_cores * sch->busy_since) : 0.0;
+	summary->steals = sch->steals;
+	latency_percentiles(&sch->waiting_times, &summary->waiting);
+	latency_percentiles(&sch->turnaround_times, &summary->turnaround);
+	latency_percentiles(&sch->response_times, &summary->response);
 }
 
 
@@ -314,8 +1552,10 @@ int scheduler_quantum_expired(int core_id, int time)
  */
 float scheduler_average_waiting_time()
 {
+	scheduler_summary_t summary;
 
-	return(s.wait_time/s.num_jobs);
+	sched_metrics(default_scheduler, &summary);
+	return(summary.average_waiting_time);
 }
 
 
@@ -327,7 +1567,10 @@ float scheduler_average_waiting_time()
  */
 float scheduler_average_turnaround_time()
 {
-	return(s.turnaround_time/s.num_jobs);
+	scheduler_summary_t summary;
+
+	sched_metrics(default_scheduler, &summary);
+	return(summary.average_turnaround_time);
 }
 
 
@@ -339,7 +1582,46 @@ float scheduler_average_turnaround_time()
  */
 float scheduler_average_response_time()
 {
-	return(s.response_time/s.num_jobs);
+	scheduler_summary_t summary;
+
+	sched_metrics(default_scheduler, &summary);
+	return(summary.average_response_time);
+}
+
+
+/**
+  Frees a scheduler instance and everything it owns.
+  @param sch the scheduler instance, which must not be used afterwards
+*/
+void sched_destroy(scheduler_t *sch)
+{
+  if(sch == NULL)
+  {
+    return;
+  }
+
+  job_table_destroy(&sch->jobs);
+  free(sch->s.core_arr);
+  queue_destroy(&sch->q);
+  if(sch->run_queues != NULL)
+  {
+    for(int i = 0; i < sch->s.num_cores; i++)
+    {
+      queue_destroy(&sch->run_queues[i]);
+    }
+    free(sch->run_queues);
+  }
+  if(sch->s.type == PSJF || sch->s.type == PPRI || sch->s.type == MLFQ)
+  {
+    priqueue_destroy(&sch->running);
+  }
+  free(sch->running_keys);
+  free(sch->running_handles);
+  free(sch->idle_cores);
+  free(sch->steal_buf);
+  free(sch->context_switches);
+  free(sch->migrations);
+  free(sch);
 }
 
 
@@ -350,14 +1632,91 @@ float scheduler_average_response_time()
 */
 void scheduler_clean_up()
 {
-  for(int i = 0; i < s.num_cores; i++)
+  sched_destroy(default_scheduler);
+  default_scheduler = NULL;
+}
+
+
+/**
+  Returns the number of heap allocations a scheduler instance has made since
+  it was created, counting the growth of its job table and queues.
+  Once the job table and queue have grown to the peak backlog this stops
+  increasing, no matter how often jobs are re-queued.
+  @param sch the scheduler instance
+  @return the number of calls to malloc/realloc made by the scheduler
+ */
+unsigned long sched_allocations(scheduler_t *sch)
+{
+  unsigned long allocations = sch->jobs.allocations + sch->steal_allocations + queue_allocations(&sch->q);
+
+  if(sch->run_queues != NULL)
+  {
+    for(int i = 0; i < sch->s.num_cores; i++)
+    {
+      allocations += queue_allocations(&sch->run_queues[i]);
+    }
+  }
+  if(sch->running_handles != NULL)
+  {
+    allocations += priqueue_allocations(&sch->running);
+  }
+  return allocations;
+}
+
+
+/**
+  Fills in the counters a scheduler instance has kept so far: comparer calls
+  and allocations, peak and mean queue depth, preemptions, quantum expiries
+  and how many of those requeued the same job, and context switches and
+  migrations per core.
+  @param sch the scheduler instance
+  @param stats where to store the counters
+ */
+void sched_get_stats(scheduler_t *sch, scheduler_stats_t *stats)
+{
+  stats->enabled = SCHEDULER_STATS;
+  stats->comparisons = queue_comparisons(&sch->q);
+  if(sch->run_queues != NULL)
   {
-    if(s.core_arr != NULL)
+    for(int i = 0; i < sch->s.num_cores; i++)
     {
-      free(s.core_arr[i]);
+      stats->comparisons += queue_comparisons(&sch->run_queues[i]);
     }
   }
-  free(s.core_arr);
+  if(sch->running_handles != NULL)
+  {
+    stats->comparisons += priqueue_comparisons(&sch->running);
+  }
+  stats->allocations = sched_allocations(sch);
+
+  stats->peak_queue_depth = sch->peak_waiting;
+  stats->mean_queue_depth = sch->waiting_since > 0 ? (float)sch->waiting_area / sch->waiting_since : 0.0;
+  stats->preemptions = sch->preemptions;
+  stats->quantum_expiries = sch->quantum_expiries;
+  stats->requeued_same_job = sch->requeued_same_job;
+  stats->num_cores = sch->s.num_cores;
+  stats->context_switches = sch->context_switches;
+  stats->migrations = sch->migrations;
+}
+
+
+/**
+  Fills in sched_get_stats() for the instance set up by scheduler_start_up().
+  @param stats where to store the counters
+ */
+void scheduler_get_stats(scheduler_stats_t *stats)
+{
+  sched_get_stats(default_scheduler, stats);
+}
+
+
+/**
+  Returns sched_allocations() for the instance set up by scheduler_start_up().
+  @return the number of calls to malloc/realloc made by the scheduler
+ */
+unsigned long scheduler_allocations()
+{
+  return sched_allocations(default_scheduler);
 }
 
 
@@ -372,8 +1731,37 @@ void scheduler_clean_up()
  */
 void scheduler_show_queue()
 {
-	for(int i = 0; i < priqueue_size(&q); i++)
+	sched_show_queue(default_scheduler);
+}
+
+
+/**
+  Prints the ids of the jobs queued in a scheduler instance, in the order
+  they will be scheduled. Per-core run queues are printed one after the
+  other, each after its core id.
+  @param sch the scheduler instance
+ */
+void sched_show_queue(scheduler_t *sch)
+{
+	job_id_t job;
+
+	if(sch->mode != QUEUE_GLOBAL)
+	{
+		for(int i = 0; i < sch->s.num_cores; i++)
+		{
+			printf("%s[%d] ", i ? "| " : "", i);
+			queue_sort(&sch->run_queues[i]);
+			for(int j = 0; (job = queue_at(&sch->run_queues[i], j)) != NO_JOB; j++)
+			{
+				printf("%d ", sch->jobs.pid[job]);
+			}
+		}
+		return;
+	}
+
+	queue_sort(&sch->q);
+	for(int j = 0; (job = queue_at(&sch->q, j)) != NO_JOB; j++)
 	{
-		printf("%d ", ((job_t*)priqueue_at(&q, i))->pid);
+		printf("%d ", sch->jobs.pid[job]);
 	}
 }
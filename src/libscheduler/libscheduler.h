@@ -4,24 +4,86 @@
 #ifndef LIBSCHEDULER_H_
 #define LIBSCHEDULER_H_
 
-
+/**
+  Set to 0 to compile out the counters reported by sched_get_stats().
+*/
+#ifndef SCHEDULER_STATS
+#define SCHEDULER_STATS 1
+#endif
 
 /**
   Constants which represent the different scheduling algorithms
 */
-typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR} scheme_t;
+typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, CFS} scheme_t;
+
+/**
+  Returned by sched_new_job() when there is no memory left to track the job.
+*/
+#define SCHEDULER_NO_MEMORY -2
+
+/**
+  Most levels an MLFQ instance can have.
+*/
+#define SCHEDULER_MLFQ_MAX_LEVELS 16
+
+/**
+  Levels and quantum of level 0 that MLFQ uses when none are given.
+*/
+#define SCHEDULER_MLFQ_LEVELS 3
+#define SCHEDULER_MLFQ_QUANTUM 2
 
-typedef struct _job_t
+/**
+  By default MLFQ boosts every this many times the quantum of its lowest level.
+*/
+#define SCHEDULER_MLFQ_BOOST_QUANTA 10
+
+/**
+  The parameters of the multi-level feedback queue (MLFQ) scheme. Arriving
+  jobs start at level 0, the highest. A job that uses up the quantum of its
+  level moves down a level, and every boost_interval time units all jobs
+  move back to level 0 (0 never boosts). Cores take the oldest job of the
+  highest level that has one, and an arriving job preempts a job running
+  below level 0.
+*/
+typedef struct _scheduler_mlfq_t
 {
-  int running_time;
-  int priority;
-  int process_time;
-  int arrival_time;
-  int jresponse_time;
-  int prev_time;
-	int scheduled;
-  int pid;
-} job_t;
+  int levels;
+  int quanta[SCHEDULER_MLFQ_MAX_LEVELS];
+  int boost_interval;
+} scheduler_mlfq_t;
+
+/**
+  Target latency that CFS uses when none is given, and how many of its
+  shortest time slices fit into it by default.
+*/
+#define SCHEDULER_CFS_LATENCY 24
+#define SCHEDULER_CFS_SLICES 8
+
+/**
+  The parameters of the completely fair (CFS) scheme. Each job gathers
+  virtual runtime as it runs, at a rate that falls with its weight, and
+  cores take the job with the least. Priority 0 has a weight of 1024, and
+  each step of priority weighs about 1.25 times less (priorities are
+  clamped to -20..19, like nice values). Within latency time units every
+  job alive runs once, for a share of latency * cores in proportion to its
+  weight, but never for less than min_granularity.
+*/
+typedef struct _scheduler_cfs_t
+{
+  int latency;
+  int min_granularity;
+} scheduler_cfs_t;
+
+/**
+  How waiting jobs are queued: in one queue shared by all cores, or in a run
+  queue per core. With per-core queues an arriving job goes to the shortest
+  queue, and a core whose queue is empty steals from the longest one, taking
+  either the job at its head (QUEUE_STEAL_HEAD) or the half of it at its
+  tail (QUEUE_STEAL_TAIL_HALF). Head and tail are in the scheme's run order:
+  by arrival for FCFS and RR, but by key for the others, so with SJF the
+  head is the shortest job and the tail half the longest ones.
+*/
+typedef enum {QUEUE_GLOBAL = 0, QUEUE_STEAL_HEAD, QUEUE_STEAL_TAIL_HALF} queue_mode_t;
 
 /**
 	A structure that holds all of the global variables to be used in calculating
@@ -35,15 +97,85 @@ typedef struct _scheduler_metrics_t
 	int longest_index;
 	int lowest_priority;
 	int lowest_core;
-	job_t **core_arr;
+	unsigned int *core_arr;
 	scheme_t type;
-	float turnaround_time;
-	float wait_time;
-	float response_time;
 }scheduler_metrics_t;
 
+/**
+	Percentiles of one per-job time, accurate to better than 1% (max is exact).
+*/
+typedef struct _scheduler_latency_t
+{
+	long long p50;
+	long long p90;
+	long long p99;
+	long long p999;
+	long long max;
+} scheduler_latency_t;
+
+/**
+	Averages and tail latencies reported by a scheduler instance once all
+	jobs have finished.
+*/
+typedef struct _scheduler_summary_t
+{
+	int num_jobs;
+	float average_waiting_time;
+	float average_turnaround_time;
+	float average_response_time;
+	float utilization;
+	unsigned long steals;
+	scheduler_latency_t waiting;
+	scheduler_latency_t turnaround;
+	scheduler_latency_t response;
+} scheduler_summary_t;
+
+/**
+	Counters kept by a scheduler instance while it runs, to explain where its
+	time goes. With SCHEDULER_STATS (and PRIQUEUE_STATS, for comparisons) set
+	to 0 they are compiled out and read 0. The per-core arrays belong to the
+	instance and are valid until it is destroyed.
+*/
+typedef struct _scheduler_stats_t
+{
+	int enabled;
+	unsigned long comparisons;        /* comparer calls made by all of the instance's queues */
+	unsigned long allocations;        /* as sched_allocations() */
+	int peak_queue_depth;             /* most jobs waiting at once, over all queues */
+	float mean_queue_depth;           /* jobs waiting, averaged over simulated time */
+	unsigned long preemptions;        /* arrivals that took a busy core (PSJF, PPRI) */
+	unsigned long quantum_expiries;   /* expiries on a busy core (RR, MLFQ, CFS) */
+	unsigned long requeued_same_job;  /* expiries that put the expired job straight back */
+	int num_cores;
+	const unsigned long *context_switches;  /* per core: times it started a different job */
+	const unsigned long *migrations;        /* per core: jobs it started that last ran elsewhere */
+} scheduler_stats_t;
+
+/**
+	An independent scheduler instance. Instances share no state, so several
+	can be used in one process, each from its own thread.
+*/
+typedef struct _scheduler_t scheduler_t;
+
+scheduler_t  *sched_create             (int cores, scheme_t scheme);
+scheduler_t  *sched_create_queues      (int cores, scheme_t scheme, queue_mode_t mode);
+scheduler_t  *sched_create_mlfq        (int cores, queue_mode_t mode, const scheduler_mlfq_t *mlfq);
+void          sched_mlfq_defaults      (scheduler_mlfq_t *mlfq, int levels, int quantum);
+scheduler_t  *sched_create_cfs         (int cores, queue_mode_t mode, const scheduler_cfs_t *cfs);
+void          sched_cfs_defaults       (scheduler_cfs_t *cfs, int latency);
+int           sched_new_job            (scheduler_t *sch, int job_number, int time, int running_time, int priority);
+int           sched_job_finished       (scheduler_t *sch, int core_id, int job_number, int time);
+int           sched_quantum_expired    (scheduler_t *sch, int core_id, int time);
+int           sched_time_slice         (scheduler_t *sch, int core_id);
+void          sched_metrics            (scheduler_t *sch, scheduler_summary_t *summary);
+unsigned long sched_allocations        (scheduler_t *sch);
+void          sched_get_stats          (scheduler_t *sch, scheduler_stats_t *stats);
+void          sched_show_queue         (scheduler_t *sch);
+void          sched_destroy            (scheduler_t *sch);
+
 /** 
-	Functions to be used in the scheduler.
+	Functions to be used in the scheduler. They operate on a default instance
+	set up by scheduler_start_up() and released by scheduler_clean_up().
 */
 void  scheduler_start_up               (int cores, scheme_t scheme);
 int   scheduler_new_job                (int job_number, int time, int running_time, int priority);
@@ -53,6 +185,8 @@ float scheduler_average_turnaround_time();
 float scheduler_average_waiting_time   ();
 float scheduler_average_response_time  ();
 void  scheduler_clean_up               ();
+unsigned long scheduler_allocations    ();
+void  scheduler_get_stats              (scheduler_stats_t *stats);
 
 void  scheduler_show_queue             ();
 
@@ -0,0 +1,1657 @@
+/** @file libsimulator.c
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libsimulator.h"
+
+
+typedef struct _simulator_job_list_t
+{
+	int job_id, arrival_time, run_time, priority;
+	int core_id, arrived;
+	int active_slot;
+} simulator_job_list_t;
+
+/*
+ * Jobs stay in jobs[] at index job_id for the whole run. The order in which jobs that finish or arrive
+ * in the same time unit are handed to the scheduler follows active[], which keeps the ids of unfinished
+ * jobs and drops finished ones by moving the last id into their slot.
+ */
+typedef struct _simulator_index_t
+{
+	int *active;         // ids of unfinished jobs; jobs[id].active_slot is the position in here
+	int *arrival_order;  // ids sorted by arrival time
+	int next_arrival;    // cursor into arrival_order
+	int *core_job;       // id of the job running on each core, or -1
+} simulator_index_t;
+
+/*
+ * Prints the header of a time unit before its first scheduler decision when the per-unit state is not
+ * printed (in that case the header was already printed at the start of the time unit).
+ */
+static void print_time_header(int time, int *header_time)
+{
+	if (*header_time != time)
+	{
+		printf("=== [TIME %d] ===\n", time);
+		*header_time = time;
+	}
+}
+
+static int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int total_jobs, simulator_index_t *index)
+{
+	if (job_id < 0 || job_id >= total_jobs || jobs[job_id].active_slot == -1 || !jobs[job_id].arrived)
+		return 0;
+
+	// A job moved off another core leaves that core idle
+	if (jobs[job_id].core_id != -1 && index->core_job[jobs[job_id].core_id] == job_id)
+		index->core_job[jobs[job_id].core_id] = -1;
+
+	jobs[job_id].core_id = core_id;
+	index->core_job[core_id] = job_id;
+	return 1;
+}
+
+static void remove_active_job(int job_id, simulator_job_list_t *jobs, int *active_jobs, simulator_index_t *index)
+{
+	int slot = jobs[job_id].active_slot;
+	int last = index->active[*active_jobs - 1];
+
+	index->active[slot] = last;
+	jobs[last].active_slot = slot;
+	jobs[job_id].active_slot = -1;
+	(*active_jobs)--;
+}
+
+static int compare_arrival(const void *a, const void *b, void *arg)
+{
+	simulator_job_list_t *jobs = arg;
+	int x = *(const int *)a, y = *(const int *)b;
+
+	if (jobs[x].arrival_time != jobs[y].arrival_time)
+		return (jobs[x].arrival_time < jobs[y].arrival_time) ? -1 : 1;
+	return x - y;
+}
+
+/*
+ * Sorts the ids in ids[0..count) by their position in active[].
+ */
+static void sort_by_active_slot(int *ids, int count, simulator_job_list_t *jobs)
+{
+	int i, j;
+
+	for (i = 1; i < count; i++)
+	{
+		int id = ids[i];
+		for (j = i; j > 0 && jobs[ids[j - 1]].active_slot > jobs[id].active_slot; j--)
+			ids[j] = ids[j - 1];
+		ids[j] = id;
+	}
+}
+
+static void print_available_jobs(simulator_job_list_t *jobs, int active_jobs, simulator_index_t *index)
+{
+	printf("Active jobs are: ");
+
+	int i, first = 1;
+	for (i = 0; i < active_jobs; i++)
+	{
+		simulator_job_list_t *job = &jobs[index->active[i]];
+		if (job->arrived)
+		{
+			if (first)
+			{
+				printf("%d", job->job_id);
+				first = 0;
+			}
+			else
+				printf(", %d", job->job_id);
+		}
+	}
+
+	if (!first)
+		printf("\n");
+}
+
+/*
+ * The timing diagram of a core is stored run-length encoded: one segment per stretch of time units in
+ * which the core ran the same job (or stayed idle, job_id == -1). The text diagram is only rendered when
+ * it is printed.
+ */
+typedef struct _timeline_segment_t
+{
+	int job_id, start, length;
+} timeline_segment_t;
+
+typedef struct _core_timeline_t
+{
+	timeline_segment_t *segments;
+	int count, capacity;
+} core_timeline_t;
+
+/*
+ * Records that job_id (-1 for idle) ran for count time units starting at time.
+ */
+static int append_timeline(core_timeline_t *timeline, int job_id, int time, int count)
+{
+	if (timeline->count > 0 && timeline->segments[timeline->count - 1].job_id == job_id)
+	{
+		timeline->segments[timeline->count - 1].length += count;
+		return 1;
+	}
+
+	if (timeline->count == timeline->capacity)
+	{
+		int capacity = timeline->capacity ? timeline->capacity * 2 : 16;
+		timeline_segment_t *segments = realloc(timeline->segments, capacity * sizeof(timeline_segment_t));
+
+		if (segments == NULL)
+		{
+			fprintf(stderr, "Out of memory.\n");
+			return 0;
+		}
+		timeline->segments = segments;
+		timeline->capacity = capacity;
+	}
+
+	timeline->segments[timeline->count].job_id = job_id;
+	timeline->segments[timeline->count].start = time;
+	timeline->segments[timeline->count].length = count;
+	timeline->count++;
+	return 1;
+}
+
+/*
+ * Writes the label the timing diagram uses for a job: 0-9, a-z, A-Z, then (id). Idle is '-'.
+ */
+static void timeline_label(int job_id, char *label)
+{
+	if (job_id == -1)
+		strcpy(label, "-");
+	else if (job_id < 10)
+		sprintf(label, "%d", job_id);
+	else if (job_id < 10 + 26)
+		sprintf(label, "%c", job_id - 10 + 'a');
+	else if (job_id < 10 + 26 + 26)
+		sprintf(label, "%c", job_id - 10 - 26 + 'A');
+	else if (snprintf(label, 10, "(%d)", job_id) >= 10)
+		label[9] = '\0';  // Ids past 7 digits are cut off, as they always were
+}
+
+/*
+ * Renders a core's timing diagram, one label per time unit.
+ */
+static void print_timeline(core_timeline_t *timeline)
+{
+	char block[4096];
+	int i;
+
+	for (i = 0; i < timeline->count; i++)
+	{
+		char label[12];
+		timeline_label(timeline->segments[i].job_id, label);
+
+		size_t unit = strlen(label);
+		size_t per_block = sizeof(block) / unit;
+		size_t filled = 0;
+		int left = timeline->segments[i].length;
+
+		while (left > 0)
+		{
+			size_t units = ((size_t)left < per_block) ? (size_t)left : per_block;
+
+			for (; filled < units; filled++)
+				memcpy(block + filled * unit, label, unit);
+
+			fwrite(block, unit, units, stdout);
+			left -= units;
+		}
+	}
+}
+
+/*
+ * Prints the counters the scheduler kept during the run.
+ */
+static void print_stats(scheduler_t *sch)
+{
+	scheduler_stats_t stats;
+	int i;
+
+	sched_get_stats(sch, &stats);
+	if (!stats.enabled)
+	{
+		printf("Scheduler counters were compiled out (SCHEDULER_STATS=0).\n\n");
+		return;
+	}
+
+	printf("SCHEDULER COUNTERS:\n");
+	printf("  Comparisons: %lu\n", stats.comparisons);
+	printf("  Allocations: %lu\n", stats.allocations);
+	printf("  Queue depth: %d peak, %.2f mean\n", stats.peak_queue_depth, stats.mean_queue_depth);
+	printf("  Preemptions: %lu\n", stats.preemptions);
+	printf("  Quantum expiries: %lu (%lu requeued the same job)\n", stats.quantum_expiries, stats.requeued_same_job);
+	for (i = 0; i < stats.num_cores; i++)
+		printf("  Core %2d: %lu context switch(es), %lu migration(s)\n", i, stats.context_switches[i], stats.migrations[i]);
+	printf("\n");
+}
+
+/*
+ * Returns the first time unit, at or after time, in which a job arrives,
+ * finishes or has its quantum expire, or -1 if there is no such time unit.
+ */
+static int next_event_time(int time, simulator_job_list_t *jobs, int total_jobs, simulator_index_t *index, int cores, int *quantum_clock, int use_quantum)
+{
+	int i, next = -1;
+
+	if (index->next_arrival < total_jobs)
+		next = jobs[index->arrival_order[index->next_arrival]].arrival_time;
+
+	for (i = 0; i < cores; i++)
+	{
+		if (index->core_job[i] != -1)
+		{
+			// A job with run_time r left after the previous time unit finishes at time - 1 + r
+			int remaining = jobs[index->core_job[i]].run_time;
+			if (use_quantum && quantum_clock[i] < remaining)
+				remaining = quantum_clock[i];
+
+			int event = time - 1 + remaining;
+			if (next == -1 || event < next)
+				next = event;
+		}
+	}
+
+	return next;
+}
+
+static void print_available_cores(int cores)
+{
+	printf("Active cores are: ");
+
+	int i;
+	for (i = 0; i < cores; i++)
+	{
+		if (i == cores - 1)
+			printf("%d\n", i);
+		else
+			printf("%d, ", i);
+	}
+}
+
+
+/*
+ * Parses an integer field, with optional blanks around it and an optional sign, starting at s (before
+ * end). Returns the position after it, or NULL if there are no digits or they exceed INT_MAX.
+ */
+static inline const char *parse_field(const char *s, const char *end, int *value)
+{
+	int negative = 0, v = 0;
+
+	while (s < end && (*s == ' ' || *s == '\t'))
+		s++;
+	if (s < end && (*s == '-' || *s == '+'))
+		negative = (*s++ == '-');
+	if (s == end || (unsigned)(*s - '0') > 9)
+		return NULL;
+
+	do
+	{
+		int digit = *s++ - '0';
+		if (v > (INT_MAX - digit) / 10)
+			return NULL;
+		v = v * 10 + digit;
+	}
+	while (s < end && (unsigned)(*s - '0') <= 9);
+
+	while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+		s++;
+
+	*value = negative ? -v : v;
+	return s;
+}
+
+
+/*
+ * Parses the "arrival time,run time,priority" fields of a job line starting at p (before end). Returns
+ * the position after the third field, which is the end of the line or a ',' before ignored fields, or
+ * NULL if the line is malformed.
+ */
+static const char *parse_job(const char *p, const char *end, simulator_trace_job_t *job)
+{
+	if ((p = parse_field(p, end, &job->arrival_time)) == NULL || p == end || *p++ != ',' ||
+	    (p = parse_field(p, end, &job->run_time)) == NULL || p == end || *p++ != ',' ||
+	    (p = parse_field(p, end, &job->priority)) == NULL || (p != end && *p != '\n' && *p != ','))
+		return NULL;
+
+	return p;
+}
+
+
+/**
+  Reads a trace file: a header line followed by one "arrival time,run time,priority" line per job.
+  The file is mapped into memory and parsed in a single pass, into an array sized by counting the lines
+  first. Blank lines are skipped and fields after the third are ignored. Problems are reported on
+  stderr, malformed lines with their line number.
+  @param file_name the path of the trace
+  @param trace the trace to fill in, released with simulator_free_trace()
+  @return 0 on success
+  @return 2 if the file cannot be read or is malformed
+ */
+int simulator_load_trace(const char *file_name, simulator_trace_t *trace)
+{
+	int fd = open(file_name, O_RDONLY);
+	struct stat st;
+
+	if (fd == -1 || fstat(fd, &st) == -1)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		if (fd != -1)
+			close(fd);
+		return 2;
+	}
+
+	trace->jobs = NULL;
+	trace->num_jobs = 0;
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return 0;
+	}
+
+	char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		return 2;
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+	const char *p = data, *end = data + st.st_size, *eol;
+
+	// Ignore the first (header) line
+	eol = memchr(p, '\n', end - p);
+	p = eol ? eol + 1 : end;
+
+	// Every job takes one line, so the line count bounds the number of jobs
+	int lines = 1;
+	for (eol = p; (eol = memchr(eol, '\n', end - eol)) != NULL; eol++)
+		lines++;
+
+	simulator_trace_job_t *jobs = malloc(lines * sizeof(simulator_trace_job_t));
+	if (jobs == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		munmap(data, st.st_size);
+		return 2;
+	}
+
+	int job_id = 0, line = 2;
+	while (p < end)
+	{
+		// Skip blank lines
+		const char *s = p;
+		while (s < end && (*s == ' ' || *s == '\t' || *s == '\r'))
+			s++;
+		if (s == end || *s == '\n')
+		{
+			p = s + 1;
+			line++;
+			continue;
+		}
+
+		simulator_trace_job_t *job = &jobs[job_id];
+		if ((p = parse_job(p, end, job)) == NULL)
+		{
+			fprintf(stderr, "Illegal file format on line %d.\n", line);
+			free(jobs);
+			munmap(data, st.st_size);
+			return 2;
+		}
+
+		// Step over any extra fields and the end of the line
+		if (p != end && *p == ',')
+		{
+			eol = memchr(p, '\n', end - p);
+			p = eol ? eol : end;
+		}
+		p++;
+		line++;
+		job_id++;
+	}
+
+	munmap(data, st.st_size);
+
+	trace->jobs = jobs;
+	trace->num_jobs = job_id;
+	return 0;
+}
+
+
+/**
+  Reads a trace file line by line with stdio, like simulator_load_trace(). This is the original loader,
+  kept as a reference point for benchmarking.
+  @param file_name the path of the trace
+  @param trace the trace to fill in, released with simulator_free_trace()
+  @return 0 on success
+  @return 2 if the file cannot be read or is malformed
+ */
+int simulator_load_trace_fgets(const char *file_name, simulator_trace_t *trace)
+{
+	FILE *file = fopen(file_name, "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		return 2;
+	}
+
+
+	int job_id = 0;
+	int jobs_ct = 10;
+	simulator_trace_job_t *jobs = malloc(jobs_ct * sizeof(simulator_trace_job_t));
+
+	char line[1024 + 1];
+	fgets(line, 1024, file);  // Ignore the first (header) line
+	while (fgets(line, 1024, file) != NULL)
+	{
+		char *saveptr;
+		char *arrival_time = strtok_r(line, ",", &saveptr);
+		char *run_time = strtok_r(NULL, ",", &saveptr);
+		char *priority = strtok_r(NULL, ",", &saveptr);
+
+		if (arrival_time != NULL && run_time != NULL && priority != NULL)
+		{
+			if (job_id == jobs_ct)
+			{
+				jobs_ct *= 2;
+				simulator_trace_job_t *grown = realloc(jobs, jobs_ct * sizeof(simulator_trace_job_t));
+
+				if (!grown)
+				{
+					fprintf(stderr, "Out of memory.\n");
+					free(jobs);
+					fclose(file);
+					return 2;
+				}
+				jobs = grown;
+			}
+
+			jobs[job_id].arrival_time = atoi(arrival_time);
+			jobs[job_id].run_time = atoi(run_time);
+			jobs[job_id].priority = atoi(priority);
+
+			job_id++;
+		}
+		else
+		{
+			fprintf(stderr, "Illegal file format.\n");
+			free(jobs);
+			fclose(file);
+			return 2;
+		}
+	}
+
+	fclose(file);
+
+	trace->jobs = jobs;
+	trace->num_jobs = job_id;
+	return 0;
+}
+
+
+/**
+  Frees the memory held by a trace.
+  @param trace a trace filled in by simulator_load_trace()
+ */
+void simulator_free_trace(simulator_trace_t *trace)
+{
+	free(trace->jobs);
+	trace->jobs = NULL;
+	trace->num_jobs = 0;
+}
+
+
+/**
+  Parses a scheme name as accepted by the -s option: fcfs, sjf, psjf, pri, ppri, rr#, mlfq#[:#] or
+  cfs[#] (case-insensitive). mlfq takes the number of levels, then optionally the quantum of level 0,
+  and cfs optionally its target latency; without one the quantum is set to 0, for the scheduler's
+  default.
+  @param name the scheme name
+  @param scheme where to store the scheme
+  @param quantum where to store the quantum of RR or of MLFQ's level 0, or CFS's target latency (left
+                 alone for other schemes)
+  @param levels where to store the number of levels of MLFQ (left alone for other schemes)
+  @return 0 on success
+  @return -1 if the name is not a known scheme
+  @return -2 if RR is not followed by a positive quantum
+  @return -3 if MLFQ is not followed by 1 to SCHEDULER_MLFQ_MAX_LEVELS levels and an optional positive quantum
+  @return -4 if CFS is followed by anything but a positive target latency
+ */
+int simulator_parse_scheme(const char *name, scheme_t *scheme, int *quantum, int *levels)
+{
+	if (strcasecmp(name, "FCFS") == 0) { *scheme = FCFS; }
+	else if (strcasecmp(name, "SJF") == 0) { *scheme = SJF; }
+	else if (strcasecmp(name, "PSJF") == 0) { *scheme = PSJF; }
+	else if (strcasecmp(name, "PRI") == 0) { *scheme = PRI; }
+	else if (strcasecmp(name, "PPRI") == 0) { *scheme = PPRI; }
+	else if (strncasecmp(name, "RR", 2) == 0)
+	{
+		char *end;
+		long q = strtol(name + 2, &end, 10);
+		*scheme = RR;
+
+		// Trailing characters are rejected, so a typo like rr3x is not run as rr3
+		if (end == name + 2 || *end != '\0' || q <= 0 || q > INT_MAX)
+			return -2;
+		*quantum = q;
+	}
+	else if (strncasecmp(name, "MLFQ", 4) == 0)
+	{
+		char *end;
+		long l = strtol(name + 4, &end, 10), q = 0;
+		*scheme = MLFQ;
+
+		if (end != name + 4 && *end == ':')
+		{
+			const char *colon = end;
+			q = strtol(colon + 1, &end, 10);
+			if (end == colon + 1 || q <= 0 || q > INT_MAX)
+				return -3;
+		}
+		if (*end != '\0' || l < 1 || l > SCHEDULER_MLFQ_MAX_LEVELS)
+			return -3;
+		*levels = l;
+		*quantum = q;
+	}
+	else if (strncasecmp(name, "CFS", 3) == 0)
+	{
+		char *end;
+		long q = strtol(name + 3, &end, 10);
+		*scheme = CFS;
+
+		if (*end != '\0' || (end != name + 3 && (q <= 0 || q > INT_MAX)))
+			return -4;
+		*quantum = q;
+	}
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/**
+  Writes the short name of a scheme, as accepted by simulator_parse_scheme().
+  @param scheme the scheme
+  @param quantum the quantum, used for RR and MLFQ, or CFS's target latency (0 for the default)
+  @param levels the number of levels, used for MLFQ
+  @param name the buffer to write to
+  @param size the size of the buffer
+ */
+void simulator_scheme_name(scheme_t scheme, int quantum, int levels, char *name, int size)
+{
+	if (scheme == FCFS) { snprintf(name, size, "fcfs"); }
+	else if (scheme == SJF) { snprintf(name, size, "sjf"); }
+	else if (scheme == PSJF) { snprintf(name, size, "psjf"); }
+	else if (scheme == PRI) { snprintf(name, size, "pri"); }
+	else if (scheme == PPRI) { snprintf(name, size, "ppri"); }
+	else if (scheme == RR) { snprintf(name, size, "rr%d", quantum); }
+	else if (scheme == MLFQ && quantum > 0) { snprintf(name, size, "mlfq%d:%d", levels, quantum); }
+	else if (scheme == MLFQ) { snprintf(name, size, "mlfq%d", levels); }
+	else if (scheme == CFS && quantum > 0) { snprintf(name, size, "cfs%d", quantum); }
+	else if (scheme == CFS) { snprintf(name, size, "cfs"); }
+	else { snprintf(name, size, "?"); }
+}
+
+
+/**
+  Parses a queue mode name as accepted by the -m option: global, head or tail (case-insensitive).
+  The earlier names oldest and half are still accepted for head and tail.
+  @param name the mode name
+  @param mode where to store the mode
+  @return 0 on success
+  @return -1 if the name is not a known mode
+ */
+int simulator_parse_queues(const char *name, queue_mode_t *mode)
+{
+	if (strcasecmp(name, "global") == 0) { *mode = QUEUE_GLOBAL; }
+	else if (strcasecmp(name, "head") == 0 || strcasecmp(name, "oldest") == 0) { *mode = QUEUE_STEAL_HEAD; }
+	else if (strcasecmp(name, "tail") == 0 || strcasecmp(name, "half") == 0) { *mode = QUEUE_STEAL_TAIL_HALF; }
+	else
+		return -1;
+
+	return 0;
+}
+
+
+/**
+  Returns the name of a queue mode, as accepted by simulator_parse_queues().
+  @param mode the queue mode
+  @return the name
+ */
+const char *simulator_queues_name(queue_mode_t mode)
+{
+	if (mode == QUEUE_STEAL_HEAD) { return "head"; }
+	else if (mode == QUEUE_STEAL_TAIL_HALF) { return "tail"; }
+	return "global";
+}
+
+
+/**
+  Creates the scheduler instance a simulation runs on: MLFQ with config->levels levels from a
+  quantum of config->quantum (SCHEDULER_MLFQ_QUANTUM if 0), CFS with a target latency of
+  config->quantum (SCHEDULER_CFS_LATENCY if 0), any other scheme as it comes.
+  @param config the number of cores, scheme, quantum, levels and queue mode
+  @return the new instance, to be released with sched_destroy()
+  @return NULL if memory ran out
+ */
+scheduler_t *simulator_create_scheduler(const simulator_config_t *config)
+{
+	if (config->scheme == MLFQ)
+	{
+		scheduler_mlfq_t mlfq;
+		sched_mlfq_defaults(&mlfq, config->levels, config->quantum > 0 ? config->quantum : SCHEDULER_MLFQ_QUANTUM);
+		return sched_create_mlfq(config->cores, config->queues, &mlfq);
+	}
+	else if (config->scheme == CFS)
+	{
+		scheduler_cfs_t cfs;
+		sched_cfs_defaults(&cfs, config->quantum > 0 ? config->quantum : SCHEDULER_CFS_LATENCY);
+		return sched_create_cfs(config->cores, config->queues, &cfs);
+	}
+	return sched_create_queues(config->cores, config->scheme, config->queues);
+}
+
+
+/**
+  Returns whether a scheme runs jobs for a quantum at a time, so that the simulation has to call
+  sched_quantum_expired().
+  @param scheme the scheme
+  @return 1 for RR, MLFQ and CFS, 0 otherwise
+ */
+int simulator_has_quantum(scheme_t scheme)
+{
+	return scheme == RR || scheme == MLFQ || scheme == CFS;
+}
+
+
+/**
+  Returns the quantum of the job just put on a core: RR's fixed quantum, or the one the scheduler
+  hands out (see sched_time_slice()).
+  @param sch the scheduler instance
+  @param config the simulation's parameters
+  @param core_id the core
+  @return the quantum, or -1 if the core is idle under a scheduler-chosen quantum
+ */
+int simulator_time_slice(scheduler_t *sch, const simulator_config_t *config, int core_id)
+{
+	if (config->scheme == RR)
+		return config->quantum;
+	return sched_time_slice(sch, core_id);
+}
+
+
+/**
+  Simulates a trace on a fresh scheduler instance and prints as much of the run as config->verbosity asks for.
+  Nothing outside the arguments is modified, so simulations can run on several threads at once.
+  @param trace the jobs to simulate
+  @param config the number of cores, scheme, quantum and output options
+  @param summary where to store the averages (may be NULL)
+  @return 0 on success
+  @return 3 if the scheduler made an invalid decision or memory ran out
+ */
+int simulator_run(const simulator_trace_t *trace, const simulator_config_t *config, scheduler_summary_t *summary)
+{
+	int cores = config->cores, sliced = simulator_has_quantum(config->scheme);
+	verbosity_t verbosity = config->verbosity;
+
+	int time = 0, i, j;
+	int header_time = -1, status = 0;
+	int total_jobs = trace->num_jobs, active_jobs = trace->num_jobs, jobs_alive = 0;
+
+	scheduler_t *sch = simulator_create_scheduler(config);
+	if (sch == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 3;
+	}
+	simulator_job_list_t *jobs = malloc(total_jobs * sizeof(simulator_job_list_t));
+
+	int *quantum_clock = malloc(cores * sizeof(int));
+	core_timeline_t *core_timeline = calloc(cores, sizeof(core_timeline_t));
+
+	simulator_index_t index;
+	index.active = malloc(total_jobs * sizeof(int));
+	index.arrival_order = malloc(total_jobs * sizeof(int));
+	index.next_arrival = 0;
+	index.core_job = malloc(cores * sizeof(int));
+
+	// Ids of the jobs that finish or arrive in the current time unit
+	int *event_jobs = malloc((total_jobs > cores ? total_jobs : cores) * sizeof(int));
+
+	for (i = 0; i < total_jobs; i++)
+	{
+		jobs[i].job_id = i;
+		jobs[i].arrival_time = trace->jobs[i].arrival_time;
+		jobs[i].run_time = trace->jobs[i].run_time;
+		jobs[i].priority = trace->jobs[i].priority;
+		jobs[i].core_id = -1;
+		jobs[i].arrived = 0;
+
+		index.active[i] = i;
+		index.arrival_order[i] = i;
+		jobs[i].active_slot = i;
+	}
+	qsort_r(index.arrival_order, total_jobs, sizeof(int), compare_arrival, jobs);
+
+	for (i = 0; i < cores; i++)
+	{
+		quantum_clock[i] = -1;
+		index.core_job[i] = -1;
+	}
+
+	while (active_jobs > 0)
+	{
+		if (verbosity >= VERBOSITY_FULL)
+			print_time_header(time, &header_time);
+
+		/*
+		 * 1. Check if any jobs finished in the last time unit.
+		 *
+		 * - Only running jobs can finish. They are handed to the scheduler in the order of active[],
+		 *   re-reading it after each removal as removals move jobs around.
+		 */
+		int finished = 0;
+		for (i = 0; i < cores; i++)
+			if (index.core_job[i] != -1 && jobs[index.core_job[i]].run_time == 0)
+				event_jobs[finished++] = index.core_job[i];
+
+		while (finished > 0)
+		{
+			sort_by_active_slot(event_jobs, finished, jobs);
+
+			// Notify the scheduler has finished
+			int job_id = event_jobs[0];
+			int core_id = jobs[job_id].core_id;
+			int new_job_id = sched_job_finished(sch, core_id, job_id, time);
+
+			if (sliced)
+				quantum_clock[core_id] = simulator_time_slice(sch, config, core_id);
+
+			// Delete the finished jobs, decrease the number of active jobs
+			remove_active_job(job_id, jobs, &active_jobs, &index);
+			index.core_job[core_id] = -1;
+			jobs_alive--;
+			memmove(&event_jobs[0], &event_jobs[1], --finished * sizeof(int));
+
+			// Set the new job
+			if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, total_jobs, &index) )
+			{
+				printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
+				print_available_jobs(jobs, active_jobs, &index);
+				status = 3;
+				goto done;
+			}
+			else if (verbosity >= VERBOSITY_EVENTS)
+			{
+				print_time_header(time, &header_time);
+				printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
+				printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+			}
+		}
+
+		/*
+		 * Check to see if we finished our last job.  (If we don't check here, we would run an extra time unit that will be totally idle.)
+		 */
+		if (active_jobs == 0)
+			break;
+
+		/*
+		 * 2. Check of any quantums expired in the last time unit.
+		 */
+		if (sliced)
+		{
+			for (i = 0; i < cores; i++)
+			{
+				if (quantum_clock[i] == 0 && index.core_job[i] != -1)
+				{
+					// Notify the scheduler the quantum has expired
+					int core_id = i;
+					int old_job_id = index.core_job[i];
+					int new_job_id = sched_quantum_expired(sch, core_id, time);
+
+					jobs[old_job_id].core_id = -1;
+					index.core_job[core_id] = -1;
+
+					quantum_clock[core_id] = simulator_time_slice(sch, config, core_id);
+
+					// Set the new job
+					if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, total_jobs, &index) )
+					{
+						printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
+						print_available_jobs(jobs, active_jobs, &index);
+						status = 3;
+						goto done;
+					}
+					else if (verbosity >= VERBOSITY_EVENTS)
+					{
+						print_time_header(time, &header_time);
+						printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
+						printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+					}
+				}
+			}
+		}
+
+
+		/*
+		 * 3. Check for any new jobs that arrive in this time unit
+		 */
+		int arrivals = 0;
+		while (index.next_arrival < total_jobs && jobs[index.arrival_order[index.next_arrival]].arrival_time <= time)
+		{
+			int id = index.arrival_order[index.next_arrival++];
+			if (jobs[id].arrival_time == time)
+				event_jobs[arrivals++] = id;
+		}
+		sort_by_active_slot(event_jobs, arrivals, jobs);
+
+		for (j = 0; j < arrivals; j++)
+		{
+			simulator_job_list_t *job = &jobs[event_jobs[j]];
+
+			int new_job_core_id = sched_new_job(sch, job->job_id, time, job->run_time, job->priority);
+			if (new_job_core_id == SCHEDULER_NO_MEMORY)
+			{
+				fprintf(stderr, "Out of memory.\n");
+				status = 3;
+				goto done;
+			}
+			job->arrived = 1;
+			jobs_alive++;
+
+			if (new_job_core_id >= 0 && new_job_core_id < cores)
+			{
+				if (verbosity >= VERBOSITY_EVENTS)
+				{
+					print_time_header(time, &header_time);
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
+							job->job_id, job->run_time, job->priority, job->job_id, new_job_core_id);
+					printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+				}
+
+				// Find if anyone is currently using the core.
+				if (index.core_job[new_job_core_id] != -1)
+					jobs[index.core_job[new_job_core_id]].core_id = -1;
+
+				// Assign the core to the new job
+				job->core_id = new_job_core_id;
+				index.core_job[new_job_core_id] = job->job_id;
+
+				if (sliced)
+					quantum_clock[new_job_core_id] = simulator_time_slice(sch, config, new_job_core_id);
+			}
+			else if (new_job_core_id == -1)
+			{
+				if (verbosity >= VERBOSITY_EVENTS)
+				{
+					print_time_header(time, &header_time);
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
+							job->job_id, job->run_time, job->priority, job->job_id);
+					printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+				}
+			}
+			else
+			{
+				printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
+				print_available_cores(cores);
+				status = 3;
+				goto done;
+			}
+		}
+
+
+		/*
+		 * 4. Run the time unit.
+		 */
+		int cores_working = 0;
+
+		for (i = 0; i < cores; i++)
+		{
+			if (index.core_job[i] != -1)
+			{
+				simulator_job_list_t *job = &jobs[index.core_job[i]];
+
+				cores_working++;
+				job->run_time--;
+				quantum_clock[i]--;
+			}
+
+			if (!append_timeline(&core_timeline[i], index.core_job[i], time, 1))
+			{
+				status = 3;
+				goto done;
+			}
+		}
+
+
+		/*
+		 * 5. Print data!
+		 */
+		if (verbosity >= VERBOSITY_FULL)
+		{
+			printf("At the end of time unit %d...\n", time);
+
+			for (i = 0; i < cores; i++)
+			{
+				printf("  Core %2d: ", i);
+				print_timeline(&core_timeline[i]);
+				printf("\n");
+			}
+
+			printf("\n");
+
+			printf("  Queue: ");
+			sched_show_queue(sch);
+			printf("\n");
+			printf("\n");
+		}
+
+
+		/*
+		 * 6. Sanity Checking
+		 *
+		 * - If there's a job alive (needing to be ran) and all CPUs are idle, the scheduler failed to schedule properly.
+		 */
+		if (jobs_alive > 0 && cores_working == 0)
+		{
+			printf("All cores are idle and at least one job remains unscheduled.\n");
+			print_available_jobs(jobs, active_jobs, &index);
+			status = 3;
+			goto done;
+		}
+
+
+		/*
+		 * 7. Increase time
+		 *
+		 * - In event-driven mode, the time units before the next arrival, completion or quantum expiry
+		 *   only run the same jobs on the same cores again, so run them all at once.
+		 */
+		time++;
+
+		if (config->event_driven)
+		{
+			int next = next_event_time(time, jobs, total_jobs, &index, cores, quantum_clock, sliced);
+
+			if (next > time)
+			{
+				int skipped = next - time;
+
+				for (i = 0; i < cores; i++)
+				{
+					if (index.core_job[i] != -1)
+					{
+						jobs[index.core_job[i]].run_time -= skipped;
+						quantum_clock[i] -= skipped;
+					}
+
+					if (!append_timeline(&core_timeline[i], index.core_job[i], time, skipped))
+					{
+						status = 3;
+						goto done;
+					}
+				}
+
+				time = next;
+			}
+		}
+	}
+
+
+	if (verbosity >= VERBOSITY_EVENTS)
+	{
+		printf("FINAL TIMING DIAGRAM:\n");
+		for (i = 0; i < cores; i++)
+		{
+			printf("  Core %2d: ", i);
+			print_timeline(&core_timeline[i]);
+			printf("\n");
+		}
+
+		printf("\n");
+	}
+	if (summary != NULL)
+		sched_metrics(sch, summary);
+	if (config->show_stats)
+		print_stats(sch);
+
+done:
+	sched_destroy(sch);
+
+	free(quantum_clock);
+	for (i=0; i < cores; i++)
+		free(core_timeline[i].segments);
+	free(core_timeline);
+	free(index.active);
+	free(index.arrival_order);
+	free(index.core_job);
+	free(event_jobs);
+	free(jobs);
+
+	return status;
+}
+
+
+/*
+ * State of a trace file read as a stream.
+ */
+typedef struct _stream_file_t
+{
+	FILE *file;
+	int line;
+	int last_arrival;
+	char buffer[1024 + 1];
+} stream_file_t;
+
+static void stream_file_close(void *state)
+{
+	stream_file_t *stream = state;
+
+	if (stream->file != stdin)
+		fclose(stream->file);
+	free(stream);
+}
+
+/*
+ * Reads the next job line of a streamed trace file. Blank lines are skipped; jobs must come in
+ * arrival order, as they are handed out without being sorted.
+ */
+static int stream_file_next(void *state, simulator_trace_job_t *job)
+{
+	stream_file_t *stream = state;
+
+	while (fgets(stream->buffer, sizeof(stream->buffer), stream->file) != NULL)
+	{
+		const char *p = stream->buffer, *end = p + strlen(p);
+		stream->line++;
+
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+			p++;
+		if (p == end)
+			continue;
+
+		if ((end[-1] != '\n' && !feof(stream->file)) || parse_job(stream->buffer, end, job) == NULL)
+		{
+			fprintf(stderr, "Illegal file format on line %d.\n", stream->line);
+			return -1;
+		}
+
+		if (job->arrival_time < stream->last_arrival)
+		{
+			fprintf(stderr, "Streamed jobs must be sorted by arrival time (line %d arrives at %d, before %d).\n",
+					stream->line, job->arrival_time, stream->last_arrival);
+			return -1;
+		}
+		stream->last_arrival = job->arrival_time;
+		return 1;
+	}
+
+	return 0;
+}
+
+
+/**
+  Opens a trace file to be read one job at a time by simulator_run_stream(). "-" reads standard input,
+  so traces can be piped in. Only the line being parsed is held in memory.
+  @param file_name the path of the trace, or "-"
+  @param source the source to set up, released with simulator_close_stream()
+  @return 0 on success
+  @return 2 if the file cannot be opened
+ */
+int simulator_open_stream(const char *file_name, simulator_source_t *source)
+{
+	stream_file_t *stream = malloc(sizeof(stream_file_t));
+	if (stream == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 2;
+	}
+
+	stream->file = strcmp(file_name, "-") == 0 ? stdin : fopen(file_name, "r");
+	if (stream->file == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
+		free(stream);
+		return 2;
+	}
+
+	// Ignore the first (header) line
+	fgets(stream->buffer, sizeof(stream->buffer), stream->file);
+	stream->line = 1;
+	stream->last_arrival = 0;
+
+	source->next = stream_file_next;
+	source->close = stream_file_close;
+	source->state = stream;
+	return 0;
+}
+
+
+/**
+  Releases a source opened by simulator_open_stream() or simulator_open_generator().
+  @param source the source
+ */
+void simulator_close_stream(simulator_source_t *source)
+{
+	if (source->close != NULL)
+		source->close(source->state);
+	source->state = NULL;
+}
+
+
+static int generator_next(void *state, simulator_trace_job_t *job)
+{
+	return tracegen_next(state, &job->arrival_time, &job->run_time, &job->priority);
+}
+
+/**
+  Makes a source that draws jobs from a synthetic trace generator in-process, with no file in between.
+  @param gen a generator set up by tracegen_init(), which stays owned by the caller
+  @param source the source to set up
+ */
+void simulator_open_generator(tracegen_t *gen, simulator_source_t *source)
+{
+	source->next = generator_next;
+	source->close = NULL;
+	source->state = gen;
+}
+
+
+/**
+  Draws every job of a synthetic trace generator into a trace, as simulator_load_trace() would read
+  the same trace from a file.
+  @param gen a generator set up by tracegen_init()
+  @param trace the trace to fill in, released with simulator_free_trace()
+  @return 0 on success
+  @return 2 if memory ran out
+ */
+int simulator_generate_trace(tracegen_t *gen, simulator_trace_t *trace)
+{
+	long count = gen->config.num_jobs - gen->emitted;
+
+	trace->num_jobs = 0;
+	trace->jobs = malloc((count > 0 ? count : 1) * sizeof(simulator_trace_job_t));
+	if (count > INT_MAX || trace->jobs == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		free(trace->jobs);
+		trace->jobs = NULL;
+		return 2;
+	}
+
+	simulator_trace_job_t *job = trace->jobs;
+	while (tracegen_next(gen, &job->arrival_time, &job->run_time, &job->priority))
+		job = &trace->jobs[++trace->num_jobs];
+
+	return 0;
+}
+
+
+/*
+ * The jobs a streamed simulation knows about: those that have arrived and not finished yet. Records
+ * live in a pool that is reused as jobs finish, and are found by job id through an open-addressing
+ * table of pool indices, so both only grow with the number of jobs alive at once.
+ */
+typedef struct _stream_job_t
+{
+	int job_id;      // -1 while the record is free
+	int run_time, priority;
+	int core_id;
+	int next_free;
+} stream_job_t;
+
+typedef struct _stream_jobs_t
+{
+	stream_job_t *jobs;
+	int capacity, live, free_list;
+	int *map;        // pool index per slot, or -1; map_size is a power of two, at least twice live
+	int map_size;
+} stream_jobs_t;
+
+static unsigned stream_hash(stream_jobs_t *table, int job_id)
+{
+	return ((unsigned)job_id * 2654435761u) & (table->map_size - 1);
+}
+
+/*
+ * Returns the map slot holding job_id, or the empty slot where it would go.
+ */
+static int stream_slot(stream_jobs_t *table, int job_id)
+{
+	unsigned i = stream_hash(table, job_id);
+
+	while (table->map[i] != -1 && table->jobs[table->map[i]].job_id != job_id)
+		i = (i + 1) & (table->map_size - 1);
+	return i;
+}
+
+static int stream_find(stream_jobs_t *table, int job_id)
+{
+	if (job_id < 0)
+		return -1;
+	return table->map[stream_slot(table, job_id)];
+}
+
+static int stream_resize_map(stream_jobs_t *table, int map_size)
+{
+	int *old = table->map, old_size = table->map_size, i;
+
+	table->map = malloc(map_size * sizeof(int));
+	if (table->map == NULL)
+	{
+		table->map = old;
+		return 0;
+	}
+	table->map_size = map_size;
+	for (i = 0; i < map_size; i++)
+		table->map[i] = -1;
+
+	for (i = 0; i < old_size; i++)
+		if (old[i] != -1)
+			table->map[stream_slot(table, table->jobs[old[i]].job_id)] = old[i];
+
+	free(old);
+	return 1;
+}
+
+/*
+ * Adds an arriving job. Returns its pool index, or -1 if memory ran out.
+ */
+static int stream_add(stream_jobs_t *table, int job_id, const simulator_trace_job_t *job)
+{
+	if ((table->live + 1) * 2 > table->map_size && !stream_resize_map(table, table->map_size * 2))
+		return -1;
+
+	if (table->free_list == -1)
+	{
+		int capacity = table->capacity * 2, i;
+		stream_job_t *jobs = realloc(table->jobs, capacity * sizeof(stream_job_t));
+
+		if (jobs == NULL)
+			return -1;
+		for (i = capacity - 1; i >= table->capacity; i--)
+		{
+			jobs[i].job_id = -1;
+			jobs[i].next_free = table->free_list;
+			table->free_list = i;
+		}
+		table->jobs = jobs;
+		table->capacity = capacity;
+	}
+
+	int index = table->free_list;
+	stream_job_t *record = &table->jobs[index];
+	table->free_list = record->next_free;
+
+	record->job_id = job_id;
+	record->run_time = job->run_time;
+	record->priority = job->priority;
+	record->core_id = -1;
+
+	table->map[stream_slot(table, job_id)] = index;
+	table->live++;
+	return index;
+}
+
+/*
+ * Forgets a finished job, shifting later entries of its probe run back so no tombstones are needed.
+ */
+static void stream_remove(stream_jobs_t *table, int index)
+{
+	int mask = table->map_size - 1;
+	int i = stream_slot(table, table->jobs[index].job_id), j = i;
+
+	for (;;)
+	{
+		j = (j + 1) & mask;
+		if (table->map[j] == -1)
+			break;
+
+		int home = stream_hash(table, table->jobs[table->map[j]].job_id);
+		if (((j - home) & mask) >= ((j - i) & mask))
+		{
+			table->map[i] = table->map[j];
+			i = j;
+		}
+	}
+	table->map[i] = -1;
+
+	table->jobs[index].job_id = -1;
+	table->jobs[index].next_free = table->free_list;
+	table->free_list = index;
+	table->live--;
+}
+
+static int stream_set_active(stream_jobs_t *table, int *core_job, int job_id, int core_id)
+{
+	int index = stream_find(table, job_id);
+	if (index == -1)
+		return 0;
+
+	// A job moved off another core leaves that core idle
+	if (table->jobs[index].core_id != -1 && core_job[table->jobs[index].core_id] == index)
+		core_job[table->jobs[index].core_id] = -1;
+
+	table->jobs[index].core_id = core_id;
+	core_job[core_id] = index;
+	return 1;
+}
+
+static void stream_print_jobs(stream_jobs_t *table)
+{
+	int i, first = 1;
+
+	printf("Active jobs are: ");
+	for (i = 0; i < table->capacity; i++)
+	{
+		if (table->jobs[i].job_id != -1)
+		{
+			printf(first ? "%d" : ", %d", table->jobs[i].job_id);
+			first = 0;
+		}
+	}
+
+	if (!first)
+		printf("\n");
+}
+
+
+/**
+  Simulates jobs read one at a time from a source, as simulated time reaches their arrival, on a fresh
+  scheduler instance. Finished jobs are dropped at once, so memory stays proportional to the jobs alive
+  at the same time rather than to the length of the trace. Job ids are given out in the order the
+  source returns jobs.
+  Differences from simulator_run():
+    - The run is always event-driven and prints at most the scheduler decisions (VERBOSITY_EVENTS);
+      no timing diagram is kept.
+    - Jobs that finish in the same time unit are handed to the scheduler in core order, and jobs that
+      arrive in the same time unit in id order. simulator_run() hands them over in the order of its
+      active[] array instead, as the original simulator did; that order depends on how many jobs the
+      trace holds, which a stream does not know until its end. The decisions are therefore only the
+      same as simulator_run()'s when no two jobs arrive, and no two jobs finish, in the same time
+      unit, eg. on one core with distinct arrival times.
+  @param source the jobs to simulate, in arrival order
+  @param config the number of cores, scheme, quantum and output options
+  @param summary where to store the averages (may be NULL)
+  @return 0 on success
+  @return 2 if the source reported a problem
+  @return 3 if the scheduler made an invalid decision or memory ran out
+ */
+int simulator_run_stream(simulator_source_t *source, const simulator_config_t *config, scheduler_summary_t *summary)
+{
+	int cores = config->cores, sliced = simulator_has_quantum(config->scheme);
+	verbosity_t verbosity = config->verbosity < VERBOSITY_EVENTS ? config->verbosity : VERBOSITY_EVENTS;
+
+	int time = 0, i;
+	int header_time = -1, status = 0, next_id = 0;
+
+	simulator_trace_job_t pending;
+	int have_pending = source->next(source->state, &pending);
+	if (have_pending < 0)
+		return 2;
+
+	scheduler_t *sch = simulator_create_scheduler(config);
+	if (sch == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 3;
+	}
+	int *quantum_clock = malloc(cores * sizeof(int));
+	int *core_job = malloc(cores * sizeof(int));
+
+	stream_jobs_t table;
+	table.capacity = 16;
+	table.jobs = malloc(table.capacity * sizeof(stream_job_t));
+	table.live = 0;
+	table.free_list = -1;
+	table.map_size = 32;
+	table.map = malloc(table.map_size * sizeof(int));
+
+	for (i = table.capacity - 1; i >= 0; i--)
+	{
+		table.jobs[i].job_id = -1;
+		table.jobs[i].next_free = table.free_list;
+		table.free_list = i;
+	}
+	for (i = 0; i < table.map_size; i++)
+		table.map[i] = -1;
+
+	for (i = 0; i < cores; i++)
+	{
+		quantum_clock[i] = -1;
+		core_job[i] = -1;
+	}
+
+	while (have_pending || table.live > 0)
+	{
+		/*
+		 * 1. Check if any jobs finished in the last time unit, in core order.
+		 */
+		for (i = 0; i < cores; i++)
+		{
+			if (core_job[i] == -1 || table.jobs[core_job[i]].run_time != 0)
+				continue;
+
+			int core_id = i;
+			int job_id = table.jobs[core_job[i]].job_id;
+			int new_job_id = sched_job_finished(sch, core_id, job_id, time);
+
+			if (sliced)
+				quantum_clock[core_id] = simulator_time_slice(sch, config, core_id);
+
+			stream_remove(&table, core_job[core_id]);
+			core_job[core_id] = -1;
+
+			if ( new_job_id != -1 && !stream_set_active(&table, core_job, new_job_id, core_id) )
+			{
+				printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
+				stream_print_jobs(&table);
+				status = 3;
+				goto done;
+			}
+			else if (verbosity >= VERBOSITY_EVENTS)
+			{
+				print_time_header(time, &header_time);
+				printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
+				printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+			}
+		}
+
+		if (!have_pending && table.live == 0)
+			break;
+
+		/*
+		 * 2. Check of any quantums expired in the last time unit.
+		 */
+		if (sliced)
+		{
+			for (i = 0; i < cores; i++)
+			{
+				if (quantum_clock[i] == 0 && core_job[i] != -1)
+				{
+					int core_id = i;
+					int old_job_id = table.jobs[core_job[i]].job_id;
+					int new_job_id = sched_quantum_expired(sch, core_id, time);
+
+					table.jobs[core_job[i]].core_id = -1;
+					core_job[core_id] = -1;
+
+					quantum_clock[core_id] = simulator_time_slice(sch, config, core_id);
+
+					if ( new_job_id != -1 && !stream_set_active(&table, core_job, new_job_id, core_id) )
+					{
+						printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
+						stream_print_jobs(&table);
+						status = 3;
+						goto done;
+					}
+					else if (verbosity >= VERBOSITY_EVENTS)
+					{
+						print_time_header(time, &header_time);
+						printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
+						printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+					}
+				}
+			}
+		}
+
+		/*
+		 * 3. Read in the jobs that arrive in this time unit.
+		 */
+		while (have_pending && pending.arrival_time <= time)
+		{
+			int job_id = next_id++;
+			int index = stream_add(&table, job_id, &pending);
+
+			if (index == -1)
+			{
+				fprintf(stderr, "Out of memory.\n");
+				status = 3;
+				goto done;
+			}
+
+			int new_job_core_id = sched_new_job(sch, job_id, time, pending.run_time, pending.priority);
+			if (new_job_core_id == SCHEDULER_NO_MEMORY)
+			{
+				fprintf(stderr, "Out of memory.\n");
+				status = 3;
+				goto done;
+			}
+
+			if (new_job_core_id >= 0 && new_job_core_id < cores)
+			{
+				if (verbosity >= VERBOSITY_EVENTS)
+				{
+					print_time_header(time, &header_time);
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
+							job_id, pending.run_time, pending.priority, job_id, new_job_core_id);
+					printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+				}
+
+				if (core_job[new_job_core_id] != -1)
+					table.jobs[core_job[new_job_core_id]].core_id = -1;
+
+				table.jobs[index].core_id = new_job_core_id;
+				core_job[new_job_core_id] = index;
+
+				if (sliced)
+					quantum_clock[new_job_core_id] = simulator_time_slice(sch, config, new_job_core_id);
+			}
+			else if (new_job_core_id == -1)
+			{
+				if (verbosity >= VERBOSITY_EVENTS)
+				{
+					print_time_header(time, &header_time);
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
+							job_id, pending.run_time, pending.priority, job_id);
+					printf("  Queue: "); sched_show_queue(sch); printf("\n\n");
+				}
+			}
+			else
+			{
+				printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
+				print_available_cores(cores);
+				status = 3;
+				goto done;
+			}
+
+			have_pending = source->next(source->state, &pending);
+			if (have_pending < 0)
+			{
+				status = 2;
+				goto done;
+			}
+		}
+
+		/*
+		 * 4. Run the time unit, checking that no job is left waiting while every core is idle.
+		 */
+		int cores_working = 0;
+
+		for (i = 0; i < cores; i++)
+		{
+			if (core_job[i] != -1)
+			{
+				cores_working++;
+				table.jobs[core_job[i]].run_time--;
+				quantum_clock[i]--;
+			}
+		}
+
+		if (table.live > 0 && cores_working == 0)
+		{
+			printf("All cores are idle and at least one job remains unscheduled.\n");
+			stream_print_jobs(&table);
+			status = 3;
+			goto done;
+		}
+
+		/*
+		 * 5. Skip ahead to the next arrival, completion or quantum expiry.
+		 */
+		time++;
+
+		int next = have_pending ? pending.arrival_time : -1;
+		for (i = 0; i < cores; i++)
+		{
+			if (core_job[i] != -1)
+			{
+				int remaining = table.jobs[core_job[i]].run_time;
+				if (sliced && quantum_clock[i] < remaining)
+					remaining = quantum_clock[i];
+
+				if (next == -1 || time - 1 + remaining < next)
+					next = time - 1 + remaining;
+			}
+		}
+
+		if (next > time)
+		{
+			for (i = 0; i < cores; i++)
+			{
+				if (core_job[i] != -1)
+				{
+					table.jobs[core_job[i]].run_time -= next - time;
+					quantum_clock[i] -= next - time;
+				}
+			}
+			time = next;
+		}
+	}
+
+	if (summary != NULL)
+		sched_metrics(sch, summary);
+	if (config->show_stats)
+		print_stats(sch);
+
+done:
+	sched_destroy(sch);
+
+	free(quantum_clock);
+	free(core_job);
+	free(table.jobs);
+	free(table.map);
+
+	return status;
+}
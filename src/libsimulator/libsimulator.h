@@ -0,0 +1,83 @@
+/** @file libsimulator.h
+ */
+
+#ifndef LIBSIMULATOR_H_
+#define LIBSIMULATOR_H_
+
+#include "../libscheduler/libscheduler.h"
+#include "../libtracegen/libtracegen.h"
+
+/**
+  How much of a simulation is printed: only the averages, the scheduler
+  decisions (plus the final timing diagram), or the complete state after
+  every time unit.
+*/
+typedef enum {VERBOSITY_SUMMARY = 0, VERBOSITY_EVENTS, VERBOSITY_FULL} verbosity_t;
+
+/**
+  One job of a trace, as read from the input file.
+*/
+typedef struct _simulator_trace_job_t
+{
+	int arrival_time, run_time, priority;
+} simulator_trace_job_t;
+
+/**
+  A loaded trace. Job ids are the positions in jobs[]. Simulations only read
+  the trace, so one trace can be shared by simulations on several threads.
+*/
+typedef struct _simulator_trace_t
+{
+	simulator_trace_job_t *jobs;
+	int num_jobs;
+} simulator_trace_t;
+
+/**
+  The parameters of one simulation. quantum is RR's quantum, the quantum of
+  MLFQ's level 0 or CFS's target latency (0 for the default), levels the
+  number of MLFQ levels.
+  With show_stats set the scheduler's counters (see sched_get_stats()) are
+  printed at the end of the run.
+*/
+typedef struct _simulator_config_t
+{
+	int cores;
+	scheme_t scheme;
+	int quantum;
+	int levels;
+	int event_driven;
+	verbosity_t verbosity;
+	queue_mode_t queues;
+	int show_stats;
+} simulator_config_t;
+
+/**
+  A source of jobs in arrival order, read one job at a time. next() stores the next job and returns 1,
+  returns 0 once there are no more jobs, or reports a problem on stderr and returns -1. close(), if
+  set, releases the state.
+*/
+typedef struct _simulator_source_t
+{
+	int (*next)(void *state, simulator_trace_job_t *job);
+	void (*close)(void *state);
+	void *state;
+} simulator_source_t;
+
+int  simulator_load_trace  (const char *file_name, simulator_trace_t *trace);
+int  simulator_load_trace_fgets(const char *file_name, simulator_trace_t *trace);
+void simulator_free_trace  (simulator_trace_t *trace);
+int  simulator_parse_scheme(const char *name, scheme_t *scheme, int *quantum, int *levels);
+void simulator_scheme_name (scheme_t scheme, int quantum, int levels, char *name, int size);
+int  simulator_parse_queues(const char *name, queue_mode_t *mode);
+const char *simulator_queues_name(queue_mode_t mode);
+scheduler_t *simulator_create_scheduler(const simulator_config_t *config);
+int  simulator_has_quantum (scheme_t scheme);
+int  simulator_time_slice  (scheduler_t *sch, const simulator_config_t *config, int core_id);
+int  simulator_run         (const simulator_trace_t *trace, const simulator_config_t *config, scheduler_summary_t *summary);
+int  simulator_open_stream (const char *file_name, simulator_source_t *source);
+void simulator_close_stream(simulator_source_t *source);
+void simulator_open_generator(tracegen_t *gen, simulator_source_t *source);
+int  simulator_generate_trace(tracegen_t *gen, simulator_trace_t *trace);
+int  simulator_run_stream  (simulator_source_t *source, const simulator_config_t *config, scheduler_summary_t *summary);
+
+#endif /* LIBSIMULATOR_H_ */
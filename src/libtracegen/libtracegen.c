@@ -0,0 +1,186 @@
+/** @file libtracegen.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <math.h>
+
+#include "libtracegen.h"
+
+
+/**
+  Fills in the default parameters: 1000 jobs from seed 1, Poisson arrivals
+  at 0.5 jobs per time unit (bursts of 8 when bursty), exponential run times
+  with a mean of 10 (Pareto alpha 1.5) and priorities 0 to 9.
+  @param config the parameters to fill in
+ */
+void tracegen_defaults(tracegen_config_t *config)
+{
+	config->seed = 1;
+	config->num_jobs = 1000;
+	config->arrivals = ARRIVALS_POISSON;
+	config->rate = 0.5;
+	config->burst = 8;
+	config->runtime = RUNTIME_EXPONENTIAL;
+	config->mean_run_time = 10;
+	config->alpha = 1.5;
+	config->min_priority = 0;
+	config->max_priority = 9;
+}
+
+
+/**
+  Parses a comma-separated list of key=value settings over the parameters
+  already in config. Keys: n (jobs), seed, arrivals (poisson|bursty), rate
+  (jobs per time unit), burst (mean jobs per burst), runtime (exp|pareto),
+  mean (mean run time), alpha (Pareto shape, above 1) and pri (lo-hi).
+  Problems are reported on stderr.
+  @param spec the settings, eg. "n=1000000,runtime=pareto,pri=0-3"
+  @param config the parameters to update
+  @return 0 on success
+  @return -1 if a setting is unknown or out of range
+ */
+int tracegen_parse_spec(const char *spec, tracegen_config_t *config)
+{
+	char *copy = strdup(spec);
+	char *saveptr, *setting;
+	int status = 0;
+
+	for (setting = strtok_r(copy, ",", &saveptr); setting != NULL && status == 0; setting = strtok_r(NULL, ",", &saveptr))
+	{
+		char *value = strchr(setting, '=');
+		if (value == NULL)
+		{
+			fprintf(stderr, "Generator setting \"%s\" is not of the form key=value.\n", setting);
+			status = -1;
+			break;
+		}
+		*value++ = '\0';
+
+		if (strcmp(setting, "n") == 0) { config->num_jobs = atol(value); status = config->num_jobs >= 0 ? 0 : -1; }
+		else if (strcmp(setting, "seed") == 0) { config->seed = strtoull(value, NULL, 10); }
+		else if (strcmp(setting, "rate") == 0) { config->rate = atof(value); status = config->rate > 0 ? 0 : -1; }
+		else if (strcmp(setting, "burst") == 0) { config->burst = atof(value); status = config->burst >= 1 ? 0 : -1; }
+		else if (strcmp(setting, "mean") == 0) { config->mean_run_time = atof(value); status = config->mean_run_time >= 1 ? 0 : -1; }
+		else if (strcmp(setting, "alpha") == 0) { config->alpha = atof(value); status = config->alpha > 1 ? 0 : -1; }
+		else if (strcmp(setting, "arrivals") == 0)
+		{
+			if (strcasecmp(value, "poisson") == 0) { config->arrivals = ARRIVALS_POISSON; }
+			else if (strcasecmp(value, "bursty") == 0) { config->arrivals = ARRIVALS_BURSTY; }
+			else { status = -1; }
+		}
+		else if (strcmp(setting, "runtime") == 0)
+		{
+			if (strcasecmp(value, "exp") == 0) { config->runtime = RUNTIME_EXPONENTIAL; }
+			else if (strcasecmp(value, "pareto") == 0) { config->runtime = RUNTIME_PARETO; }
+			else { status = -1; }
+		}
+		else if (strcmp(setting, "pri") == 0)
+		{
+			if (sscanf(value, "%d-%d", &config->min_priority, &config->max_priority) != 2 ||
+			    config->min_priority > config->max_priority)
+				status = -1;
+		}
+		else
+		{
+			fprintf(stderr, "Unknown generator setting \"%s\".\n", setting);
+			status = -1;
+			break;
+		}
+
+		if (status != 0)
+			fprintf(stderr, "Generator setting %s has an invalid value \"%s\".\n", setting, value);
+	}
+
+	free(copy);
+	return status;
+}
+
+
+/**
+  Starts a generator.
+  @param gen the generator
+  @param config the parameters of the trace
+ */
+void tracegen_init(tracegen_t *gen, const tracegen_config_t *config)
+{
+	gen->config = *config;
+	gen->state = config->seed;
+	gen->clock = 0;
+	gen->emitted = 0;
+	gen->burst_left = 0;
+}
+
+
+/*
+ * splitmix64: a small, fast generator whose output does not depend on the C library.
+ */
+static unsigned long long next_random(tracegen_t *gen)
+{
+	unsigned long long z = (gen->state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * Returns a uniform double in (0, 1].
+ */
+static double next_uniform(tracegen_t *gen)
+{
+	return ((next_random(gen) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static double next_exponential(tracegen_t *gen, double mean)
+{
+	return -mean * log(next_uniform(gen));
+}
+
+
+/**
+  Draws the next job. Arrival times never decrease.
+  @param gen the generator
+  @param arrival_time where to store the arrival time
+  @param run_time where to store the run time (at least 1)
+  @param priority where to store the priority
+  @return 1 if a job was drawn
+  @return 0 once config.num_jobs jobs have been drawn
+ */
+int tracegen_next(tracegen_t *gen, int *arrival_time, int *run_time, int *priority)
+{
+	tracegen_config_t *config = &gen->config;
+
+	if (gen->emitted == config->num_jobs)
+		return 0;
+
+	if (config->arrivals == ARRIVALS_POISSON)
+		gen->clock += next_exponential(gen, 1 / config->rate);
+	else if (gen->burst_left == 0)
+	{
+		// Burst sizes are geometric with mean burst; bursts come burst / rate apart on average
+		gen->clock += next_exponential(gen, config->burst / config->rate);
+		gen->burst_left = 1 + (long)floor(log(next_uniform(gen)) / log(1 - 1 / config->burst));
+	}
+	if (config->arrivals == ARRIVALS_BURSTY)
+		gen->burst_left--;
+
+	double run;
+	if (config->runtime == RUNTIME_EXPONENTIAL)
+		run = next_exponential(gen, config->mean_run_time);
+	else
+	{
+		// Pareto with scale x_m = mean (alpha - 1) / alpha has the requested mean
+		double scale = config->mean_run_time * (config->alpha - 1) / config->alpha;
+		run = scale / pow(next_uniform(gen), 1 / config->alpha);
+	}
+
+	*arrival_time = gen->clock < INT_MAX / 2 ? (int)gen->clock : INT_MAX / 2;
+	*run_time = run < 1 ? 1 : (run < INT_MAX / 4 ? (int)(run + 0.5) : INT_MAX / 4);
+	*priority = config->min_priority + (int)(next_random(gen) % (unsigned long long)(config->max_priority - config->min_priority + 1));
+
+	gen->emitted++;
+	return 1;
+}
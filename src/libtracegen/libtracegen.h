@@ -0,0 +1,54 @@
+/** @file libtracegen.h
+ */
+
+#ifndef LIBTRACEGEN_H_
+#define LIBTRACEGEN_H_
+
+/**
+  How arrival times are drawn: a Poisson process, or bursts of jobs that
+  arrive in the same time unit, the bursts themselves forming a Poisson
+  process. Both average rate jobs per time unit.
+*/
+typedef enum {ARRIVALS_POISSON = 0, ARRIVALS_BURSTY} tracegen_arrivals_t;
+
+/**
+  How run times are drawn: exponential, or Pareto (heavy-tailed), both with
+  the configured mean.
+*/
+typedef enum {RUNTIME_EXPONENTIAL = 0, RUNTIME_PARETO} tracegen_runtime_t;
+
+/**
+  The parameters of a synthetic trace. The same parameters always produce
+  the same trace.
+*/
+typedef struct _tracegen_config_t
+{
+	unsigned long long seed;
+	long num_jobs;
+	tracegen_arrivals_t arrivals;
+	double rate;
+	double burst;
+	tracegen_runtime_t runtime;
+	double mean_run_time;
+	double alpha;
+	int min_priority, max_priority;
+} tracegen_config_t;
+
+/**
+  A generator in progress.
+*/
+typedef struct _tracegen_t
+{
+	tracegen_config_t config;
+	unsigned long long state;
+	double clock;
+	long emitted;
+	long burst_left;
+} tracegen_t;
+
+void tracegen_defaults  (tracegen_config_t *config);
+int  tracegen_parse_spec(const char *spec, tracegen_config_t *config);
+void tracegen_init      (tracegen_t *gen, const tracegen_config_t *config);
+int  tracegen_next      (tracegen_t *gen, int *arrival_time, int *run_time, int *priority);
+
+#endif /* LIBTRACEGEN_H_ */
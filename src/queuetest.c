@@ -16,6 +16,11 @@ int compare2(const void * a, const void * b)
 	return ( *(int*)b - *(int*)a );
 }
 
+int key1(const void * a)
+{
+	return ( *(int*)a / 10 );
+}
+
 int main()
 {
 	priqueue_t q, q2;
@@ -65,9 +70,152 @@ int main()
 		printf("%d ", *((int *)priqueue_at(&q2, i)) );
 	printf("\n");
 
+	/* Re-queueing recycles list nodes instead of allocating new ones. */
+	unsigned long allocations = priqueue_allocations(&q);
+	for (i = 0; i < 1000; i++)
+		priqueue_offer(&q, priqueue_poll(&q));
+	printf("New allocations after requeues: %lu (expected 0).\n", priqueue_allocations(&q) - allocations);
+
 	priqueue_destroy(&q2);
 	priqueue_destroy(&q);
 
+	/* Repeat the checks against the binary and 4-ary heap backends. */
+	int arity;
+	for (arity = 2; arity <= 4; arity += 2)
+	{
+		priqueue_init_heap(&q, compare1, arity);
+		priqueue_init_heap(&q2, compare2, arity);
+
+		priqueue_offer(&q, &values[12]);
+		priqueue_offer(&q, &values[13]);
+		priqueue_offer(&q, &values[14]);
+		priqueue_offer(&q, &values[12]);
+		priqueue_offer(&q, &values[12]);
+		printf("Heap(%d) total elements: %d (expected 5).\n", arity, priqueue_size(&q));
+
+		val = *((int *)priqueue_poll(&q));
+		printf("Heap(%d) top element: %d (expected 12).\n", arity, val);
+
+		vals_removed = priqueue_remove(&q, &values[12]);
+		printf("Heap(%d) elements removed: %d (expected 2).\n", arity, vals_removed);
+
+		priqueue_offer(&q, &values[10]);
+		priqueue_offer(&q, &values[30]);
+		priqueue_offer(&q, &values[20]);
+
+		for (i = 99; i >= 40; i--)
+			priqueue_offer(&q2, &values[i]);
+		priqueue_offer(&q2, &values[10]);
+		priqueue_offer(&q2, &values[30]);
+		priqueue_offer(&q2, &values[20]);
+		while (priqueue_size(&q2) > 3)
+			priqueue_poll(&q2);
+
+		printf("Heap(%d) elements in order queue (expected 10 13 14 20 30): ", arity);
+		for (i = 0; i < priqueue_size(&q); i++)
+			printf("%d ", *((int *)priqueue_at(&q, i)) );
+		printf("\n");
+
+		printf("Heap(%d) elements in reverse order queue (expected 30 20 10): ", arity);
+		priqueue_iter_t it;
+		int *elem;
+		priqueue_iter_begin(&q2, &it);
+		while ((elem = priqueue_iter_next(&it)) != NULL)
+			printf("%d ", *elem);
+		printf("\n");
+
+		val = *((int *)priqueue_remove_at(&q, 2));
+		printf("Heap(%d) removed at index 2: %d (expected 14).\n", arity, val);
+
+		/* Equal elements must come out in the order they were offered. */
+		priqueue_destroy(&q);
+		priqueue_init_heap(&q, compare1, arity);
+		int ties[3] = { 7, 7, 7 };
+		priqueue_offer(&q, &ties[0]);
+		priqueue_offer(&q, &values[3]);
+		priqueue_offer(&q, &ties[1]);
+		priqueue_offer(&q, &ties[2]);
+		priqueue_poll(&q);
+		printf("Heap(%d) ties kept in FIFO order: %s (expected yes).\n", arity,
+				(priqueue_poll(&q) == &ties[0] && priqueue_poll(&q) == &ties[1] && priqueue_poll(&q) == &ties[2]) ? "yes" : "no");
+
+		/* Handles stay attached to their element while the heap reorders. */
+		while (priqueue_size(&q2) > 0)
+			priqueue_poll(&q2);
+		int keys[6] = { 50, 40, 30, 20, 10, 60 };
+		int handles[6];
+		for (i = 0; i < 6; i++)
+			handles[i] = priqueue_offer_handle(&q2, &keys[i]);
+		keys[4] = 70;
+		priqueue_update_key(&q2, handles[4]);
+		printf("Heap(%d) top after raising a key: %d (expected 70).\n", arity, *((int *)priqueue_peek(&q2)));
+		keys[4] = 5;
+		priqueue_update_key(&q2, handles[4]);
+		printf("Heap(%d) removed by handle: %d (expected 40).\n", arity, *((int *)priqueue_remove_handle(&q2, handles[1])));
+		printf("Heap(%d) stale handle: %s (expected NULL).\n", arity, priqueue_remove_handle(&q2, handles[1]) ? "set" : "NULL");
+		printf("Heap(%d) elements in reverse order queue (expected 60 50 30 20 5): ", arity);
+		while (priqueue_size(&q2) > 0)
+			printf("%d ", *((int *)priqueue_poll(&q2)) );
+		printf("\n");
+
+		priqueue_destroy(&q2);
+		priqueue_destroy(&q);
+	}
+
+	/* The FIFO backend ignores values and keeps offer order, also across growth. */
+	priqueue_init_fifo(&q);
+	for (i = 0; i < 40; i++)
+	{
+		priqueue_offer(&q, &values[i]);
+		priqueue_offer(&q, &values[99 - i]);
+		priqueue_poll(&q);
+	}
+	printf("FIFO total elements: %d (expected 40).\n", priqueue_size(&q));
+	printf("FIFO front and back: %d %d (expected 20 60).\n",
+			*((int *)priqueue_peek(&q)), *((int *)priqueue_at(&q, priqueue_size(&q) - 1)));
+
+	priqueue_offer(&q, &values[79]);
+	vals_removed = priqueue_remove(&q, &values[79]);
+	printf("FIFO elements removed: %d (expected 2).\n", vals_removed);
+	val = *((int *)priqueue_remove_at(&q, 1));
+	printf("FIFO removed at index 1: %d (expected 21).\n", val);
+	printf("FIFO top element: %d (expected 20).\n", *((int *)priqueue_poll(&q)));
+	priqueue_destroy(&q);
+
+	/* The bucket backend merges in-range buckets with the out-of-range heap. */
+	priqueue_init_buckets(&q, compare1, key1, 4);
+	priqueue_offer(&q, &values[35]);
+	priqueue_offer(&q, &values[12]);
+	priqueue_offer(&q, &values[90]);
+	priqueue_offer(&q, &values[31]);
+	priqueue_offer(&q, &values[10]);
+	priqueue_offer(&q, &values[45]);
+	priqueue_offer(&q, &values[12]);
+	printf("Bucket total elements: %d (expected 7).\n", priqueue_size(&q));
+
+	printf("Bucket elements in order queue (expected 10 12 12 31 35 45 90): ");
+	for (i = 0; i < priqueue_size(&q); i++)
+		printf("%d ", *((int *)priqueue_at(&q, i)) );
+	printf("\n");
+
+	void *snapshot[8];
+	int count = priqueue_snapshot(&q, snapshot, 8);
+	printf("Bucket snapshot of %d (expected 10 12 12 31 35 45 90): ", count);
+	for (i = 0; i < count; i++)
+		printf("%d ", *((int *)snapshot[i]) );
+	printf("\n");
+
+	vals_removed = priqueue_remove(&q, &values[12]);
+	printf("Bucket elements removed: %d (expected 2).\n", vals_removed);
+	val = *((int *)priqueue_remove_at(&q, 3));
+	printf("Bucket removed at index 3: %d (expected 45).\n", val);
+
+	printf("Bucket polled (expected 10 31 35 90): ");
+	while (priqueue_size(&q) > 0)
+		printf("%d ", *((int *)priqueue_poll(&q)) );
+	printf("\n");
+	priqueue_destroy(&q);
+
 	free(values);
 
 	return 0;
@@ -7,88 +7,78 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <assert.h>
+#include <strings.h>
 
-#include "libscheduler/libscheduler.h"
+#include "libsimulator/libsimulator.h"
 
 
-typedef struct _simulator_job_list_t
-{
-	int job_id, arrival_time, run_time, priority;
-	int core_id, arrived;
-} simulator_job_list_t;
+/*
+ * All output goes through stdout with this buffer, so it is written out in large blocks.
+ */
+static char output_buffer[1 << 20];
 
 void print_usage(char *program_name)
 {
-	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> <input file>\n", program_name);
+	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> [-e] [-v <level>] [-m <queues>] [-l <loader>] [-S] [-i] [-p] <input file> | -g <settings>\n", program_name);
 	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
 	fprintf(stderr, "\n");
-	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq#[:#], cfs[#]\n");
+	fprintf(stderr, "  mlfq takes the number of levels and optionally the quantum of the top level, which doubles\n");
+	fprintf(stderr, "  at each level below (default %d), eg. mlfq3 or mlfq3:4\n", SCHEDULER_MLFQ_QUANTUM);
+	fprintf(stderr, "  cfs optionally takes the target latency its time slices are shared out of (default %d),\n", SCHEDULER_CFS_LATENCY);
+	fprintf(stderr, "  eg. cfs or cfs12; jobs are weighted by priority\n");
+	fprintf(stderr, "  -e  event-driven: skip time units in which no job arrives, finishes or\n");
+	fprintf(stderr, "      has its quantum expire (only those time units are printed)\n");
+	fprintf(stderr, "  -v  0: averages only, 1: scheduler decisions and final diagram, 2: every time unit (default)\n");
+	fprintf(stderr, "  -m  global: one queue for all cores (default), head/tail: a run queue per core, idle cores\n");
+	fprintf(stderr, "      steal the job at the head / the half at the tail of the longest queue, in the scheme's\n");
+	fprintf(stderr, "      run order (arrival for fcfs and rr, key for the others; steals are printed)\n");
+	fprintf(stderr, "  -l  mmap: map the input file and parse it in one pass (default), fgets: read it line by line\n");
+	fprintf(stderr, "  -S  stream: read jobs as simulated time reaches them (\"-\" reads stdin) and keep only live\n");
+	fprintf(stderr, "      jobs in memory; jobs must be sorted by arrival, the run is event-driven, at most -v 1\n");
+	fprintf(stderr, "      is printed and there is no timing diagram; jobs that arrive or finish in the same time\n");
+	fprintf(stderr, "      unit are handed to the scheduler in file / core order, so those can be scheduled\n");
+	fprintf(stderr, "      differently than without -S\n");
+	fprintf(stderr, "  -i  print the scheduler's counters (comparisons, allocations, queue depth, preemptions,\n");
+	fprintf(stderr, "      quantum expiries, context switches and migrations per core) before the averages\n");
+	fprintf(stderr, "  -p  print the p50, p90, p99, p99.9 and max of each time next to its average\n");
+	fprintf(stderr, "  -g  generate a synthetic trace in-process instead of reading a file; settings are as for\n");
+	fprintf(stderr, "      tracegen, eg. -g n=1000000,arrivals=bursty,runtime=pareto (\"-g n=1000\" for the defaults)\n");
 }
 
-int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int active_jobs)
-{
-	int i;
-	for (i = 0; i < active_jobs; i++)
-	{
-		if (jobs[i].job_id == job_id && jobs[i].arrived)
-		{
-			jobs[i].core_id = core_id;
-			return 1;
-		}
-	}
-
-	return 0;
-}
-
-void print_available_jobs(simulator_job_list_t *jobs, int active_jobs)
-{
-	printf("Active jobs are: ");
-
-	int i, first = 1;
-	for (i = 0; i < active_jobs; i++)
-	{
-		if (jobs[i].arrived)
-		{
-			if (first)
-			{
-				printf("%d", jobs[i].job_id);
-				first = 0;
-			}
-			else
-				printf(", %d", jobs[i].job_id);
-		}
-	}
-
-	if (!first)
-		printf("\n");
-}
-
-void print_available_cores(int cores)
+/*
+ * Ends an average's line, with the percentiles of the same time if they were asked for.
+ */
+void print_percentiles(int show, const scheduler_latency_t *latency)
 {
-	printf("Active cores are: ");
-
-	int i;
-	for (i = 0; i < cores; i++)
-	{
-		if (i == cores - 1)
-			printf("%d\n", i);
-		else
-			printf("%d, ", i);
-	}
+	if (show)
+		printf(" (p50 %lld, p90 %lld, p99 %lld, p99.9 %lld, max %lld)", latency->p50, latency->p90,
+				latency->p99, latency->p999, latency->max);
+	printf("\n");
 }
 
-
 int main(int argc, char **argv)
 {
 	int c;
-	int cores = 0, scheme = -1, quantum = 0;
-	char *file_name;
+	int cores = 0, quantum = 0, levels = 0;
+	scheme_t scheme = -1;
+	int event_driven = 0;
+	verbosity_t verbosity = VERBOSITY_FULL;
+	queue_mode_t queues = QUEUE_GLOBAL;
+	int use_fgets = 0, streaming = 0, verbosity_given = 0, show_stats = 0;
+	int show_percentiles = 0;
+	char *file_name = NULL;
+	int generate = 0;
+	tracegen_config_t generator;
+
+	tracegen_defaults(&generator);
+
+	setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
 
 	/*
 	 * Parse command line options.
 	 */
-	while ((c = getopt(argc, argv, "c:s:")) != -1)
+	while ((c = getopt(argc, argv, "c:s:ev:m:l:Sipg:")) != -1)
 	{
 		switch (c)
 		{
@@ -104,25 +94,83 @@ int main(int argc, char **argv)
 				break;
 
 			case 's':
-				if (strcasecmp(optarg, "FCFS") == 0) { scheme = FCFS; }
-				else if (strcasecmp(optarg, "SJF") == 0) { scheme = SJF; }
-				else if (strcasecmp(optarg, "PSJF") == 0) { scheme = PSJF; }
-				else if (strcasecmp(optarg, "PRI") == 0) { scheme = PRI; }
-				else if (strcasecmp(optarg, "PPRI") == 0) { scheme = PPRI; }
-				else if (strncasecmp(optarg, "RR", 2) == 0)
+				switch (simulator_parse_scheme(optarg, &scheme, &quantum, &levels))
 				{
-					scheme = RR;
-					quantum = atoi(optarg + 2);
-
-					if (quantum <= 0)
-					{
+					case -2:
 						fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of RR. (Eg: -s RR2)\n");
 						print_usage(argv[0]);
 						return 1;
-					}
+
+					case -3:
+						fprintf(stderr, "Option -s <scheme> requires 1 to %d levels for MLFQ, then optionally a positive quantum. (Eg: -s MLFQ3 or -s MLFQ3:4)\n",
+								SCHEDULER_MLFQ_MAX_LEVELS);
+						print_usage(argv[0]);
+						return 1;
+
+					case -4:
+						fprintf(stderr, "Option -s <scheme> takes an optional positive target latency for CFS. (Eg: -s CFS or -s CFS12)\n");
+						print_usage(argv[0]);
+						return 1;
 				}
 				break;
 
+			case 'e':
+				event_driven = 1;
+				break;
+
+			case 'v':
+				verbosity = atoi(optarg);
+				verbosity_given = 1;
+
+				if (verbosity < VERBOSITY_SUMMARY || verbosity > VERBOSITY_FULL)
+				{
+					fprintf(stderr, "Option -v <level> requires a level between 0 and 2.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'm':
+				if (simulator_parse_queues(optarg, &queues) != 0)
+				{
+					fprintf(stderr, "Option -m <queues> requires one of global, head or tail.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'l':
+				if (strcasecmp(optarg, "mmap") == 0) { use_fgets = 0; }
+				else if (strcasecmp(optarg, "fgets") == 0) { use_fgets = 1; }
+				else
+				{
+					fprintf(stderr, "Option -l <loader> requires either mmap or fgets.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'S':
+				streaming = 1;
+				break;
+
+			case 'i':
+				show_stats = 1;
+				break;
+
+			case 'p':
+				show_percentiles = 1;
+				break;
+
+			case 'g':
+				if (tracegen_parse_spec(optarg, &generator) != 0)
+				{
+					print_usage(argv[0]);
+					return 1;
+				}
+				generate = 1;
+				break;
+
 			case '?':
 				print_usage(argv[0]);
 				return 1;
@@ -147,346 +195,113 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
-	if (optind == argc - 1)
+	if (generate && optind == argc)
+		;
+	else if (!generate && optind == argc - 1)
 		file_name = argv[optind];
 	else
 	{
-		fprintf(stderr, "A single input file is required.\n");
+		fprintf(stderr, "A single input file, or -g <settings> and no file, is required.\n");
 		print_usage(argv[0]);
 		return 1;
 	}
 
 
-	/*
-	 * Open the file, read the file, and populate the jobs data structure.
-	 */
-	FILE *file = fopen(file_name, "r");
-	if (file == NULL)
-	{
-		fprintf(stderr, "Unable to open file \"%s\".\n", file_name);
-		return 2;
-	}
-
-
-	int job_id = 0;
-	int jobs_ct = 10;
-	simulator_job_list_t* jobs = malloc(jobs_ct * sizeof(simulator_job_list_t));
-
-	char line[1024 + 1];
-	fgets(line, 1024, file);  // Ignore the first (header) line
-	while (fgets(line, 1024, file) != NULL)
+	if (streaming && verbosity == VERBOSITY_FULL)
 	{
-		char *arrival_time = strtok(line, ",");
-		char *run_time = strtok(NULL, ",");
-		char *priority = strtok(NULL, ",");
-
-		if (arrival_time != NULL && run_time != NULL && priority != NULL)
+		if (verbosity_given)
 		{
-			if (job_id == jobs_ct)
-			{
-				jobs_ct *= 2;
-				jobs = realloc(jobs, jobs_ct * sizeof(simulator_job_list_t));
-
-				if (!jobs)
-				{
-					fprintf(stderr, "Out of memory.\n");
-					return 2;
-				}
-			}
-
-			jobs[job_id].job_id = job_id;
-			jobs[job_id].arrival_time = atoi(arrival_time);
-			jobs[job_id].run_time = atoi(run_time);
-			jobs[job_id].priority = atoi(priority);
-			jobs[job_id].core_id = -1;
-			jobs[job_id].arrived = 0;
-
-			job_id++;
-		}
-		else
-		{
-			fprintf(stderr, "Illegal file format.\n");
-			return 2;
+			fprintf(stderr, "Option -S prints at most -v 1, as no timing diagram is kept.\n");
+			print_usage(argv[0]);
+			return 1;
 		}
+		verbosity = VERBOSITY_EVENTS;
 	}
 
-	fclose(file);
+	simulator_config_t config;
+	config.cores = cores;
+	config.scheme = scheme;
+	config.quantum = quantum;
+	config.levels = levels;
+	config.event_driven = event_driven;
+	config.verbosity = verbosity;
+	config.queues = queues;
+	config.show_stats = show_stats;
 
 
 	/*
-	 * Run the simulation.
+	 * Open the file, read the file, and populate the jobs data structure (unless streaming, where
+	 * jobs are read as the simulation reaches them). A generated trace takes the place of the file.
 	 */
+	simulator_trace_t trace;
+	simulator_source_t source;
+	tracegen_t gen;
+	int status = 0;
+
+	if (generate)
+		tracegen_init(&gen, &generator);
+
+	if (streaming && generate)
+		simulator_open_generator(&gen, &source);
+	else if (streaming)
+		status = simulator_open_stream(file_name, &source);
+	else if (generate)
+		status = simulator_generate_trace(&gen, &trace);
+	else if (use_fgets)
+		status = simulator_load_trace_fgets(file_name, &trace);
+	else
+		status = simulator_load_trace(file_name, &trace);
 
-	printf("Loaded %d core(s) and %d job(s) using ", cores, job_id);
-	if (scheme == FCFS) { printf("First Come First Served (FCFS)"); }
-	else if (scheme == SJF) { printf("Non-preemptive Shortest Job First (SJF)"); }
-	else if (scheme == PSJF) { printf("Preemptive Shortest Job First (PSJF)"); }
-	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
-	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
-	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
-	printf(" scheduling...\n\n");
-
-	scheduler_start_up(cores, scheme);
-
+	if (status != 0)
+		return status;
 
-	int time = 0, i, j;
-	int active_jobs = job_id, jobs_alive = 0;
 
-	int *quantum_clock = malloc(cores * sizeof(int));
-	char **core_timing_diagram = malloc(cores * sizeof(char *));
-	int core_timing_diagram_size = 1024;
+	/*
+	 * Run the simulation.
+	 */
 
-	for (i = 0; i < cores; i++)
+	if (verbosity >= VERBOSITY_EVENTS)
 	{
-		quantum_clock[i] = -1;
-		core_timing_diagram[i] = malloc(core_timing_diagram_size + 1);
-		core_timing_diagram[i][0] = '\0';
+		if (streaming)
+			printf("Streaming jobs to %d core(s) using ", cores);
+		else
+			printf("Loaded %d core(s) and %d job(s) using ", cores, trace.num_jobs);
+		if (scheme == FCFS) { printf("First Come First Served (FCFS)"); }
+		else if (scheme == SJF) { printf("Non-preemptive Shortest Job First (SJF)"); }
+		else if (scheme == PSJF) { printf("Preemptive Shortest Job First (PSJF)"); }
+		else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
+		else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
+		else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
+		else if (scheme == MLFQ) { printf("Multi-level Feedback Queue (MLFQ) with %d level(s) from a quantum of %d", levels, quantum > 0 ? quantum : SCHEDULER_MLFQ_QUANTUM); }
+		else if (scheme == CFS) { printf("Completely Fair Scheduler (CFS) with a target latency of %d", quantum > 0 ? quantum : SCHEDULER_CFS_LATENCY); }
+		if (queues != QUEUE_GLOBAL) { printf(" on per-core run queues (steal %s)", simulator_queues_name(queues)); }
+		printf(" scheduling...\n\n");
 	}
 
-	while (active_jobs > 0)
+	scheduler_summary_t summary;
+	if (streaming)
 	{
-		printf("=== [TIME %d] ===\n", time);
-
-		/*
-		 * 1. Check if any jobs finished in the last time unit.
-		 */
-		for (i = 0; i < active_jobs; i++)
-		{
-			if (jobs[i].run_time == 0)
-			{
-				// Notify the scheduler has finished
-				int job_id = jobs[i].job_id;
-				int core_id = jobs[i].core_id;
-				int new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
-
-				if (scheme == RR)
-					quantum_clock[jobs[i].core_id] = quantum;
-
-				// Delete the finished jobs, decrease the number of active jobs
-				if (i != active_jobs - 1)
-					memcpy(&jobs[i], &jobs[active_jobs - 1], sizeof(simulator_job_list_t));
-				active_jobs--;
-				jobs_alive--;
-				i--;
-
-				// Set the new job
-				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-				{
-					printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
-					print_available_jobs(jobs, active_jobs);
-					return 3;
-				}
-				else
-				{
-					printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-				}
-			}
-		}
-
-		/*
-		 * Check to see if we finished our last job.  (If we don't check here, we would run an extra time unit that will be totally idle.)
-		 */
-		if (active_jobs == 0)
-			break;
-
-		/*
-		 * 2. Check of any quantums expired in the last time unit.
-		 */
-		if (scheme == RR)
-		{
-			for (i = 0; i < cores; i++)
-			{
-				if (quantum_clock[i] == 0)
-				{
-					for (j = 0; j < active_jobs; j++)
-					{
-						if (jobs[j].core_id == i)
-						{
-							// Notify the scheduler the quantum has expired
-							int core_id = jobs[j].core_id;
-							int old_job_id = jobs[j].job_id;
-							int new_job_id = scheduler_quantum_expired(jobs[j].core_id, time);
-
-							jobs[j].core_id = -1;
-
-							quantum_clock[core_id] = quantum;
-
-							// Set the new job
-							if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-							{
-								printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
-								print_available_jobs(jobs, active_jobs);
-								return 3;
-							}
-							else
-							{
-								printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
-								printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-							}
-
-							break;
-						}
-					}
-				}
-			}
-		}
-
-
-		/*
-		 * 3. Check for any new jobs that arrive in this time unit
-		 */
-		for (i = 0; i < active_jobs; i++)
-		{
-			if (jobs[i].arrival_time == time)
-			{
-				int new_job_core_id = scheduler_new_job(jobs[i].job_id, time, jobs[i].run_time, jobs[i].priority);
-				jobs[i].arrived = 1;
-				jobs_alive++;
-
-				if (new_job_core_id >= 0 && new_job_core_id < cores)
-				{
-					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id, new_job_core_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-
-					// Find if anyone is currently using the core.
-					for (j = 0; j < active_jobs; j++)
-						if (jobs[j].core_id == new_job_core_id)
-							jobs[j].core_id = -1;
-
-					// Assign the core to the new job
-					jobs[i].core_id = new_job_core_id;
-
-					if (scheme == RR)
-						quantum_clock[new_job_core_id] = quantum;
-				}
-				else if (new_job_core_id == -1)
-				{
-					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id);
-					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-				}
-				else
-				{
-					printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
-					print_available_cores(cores);
-					return 3;
-				}
-			}
-		}
-
-
-		/*
-		 * 4. Run the time unit.
-		 */
-		char time_string[cores][11];
-		int cores_working = 0;
-
-		for (i = 0; i < cores; i++)
-			time_string[i][0] = '\0';
-
-		for (i = 0; i < active_jobs; i++)
-		{
-			if (jobs[i].core_id != -1)
-			{
-				cores_working++;
-				jobs[i].run_time--;
-				quantum_clock[jobs[i].core_id]--;
-
-				assert(time_string[jobs[i].core_id][0] == '\0');
-
-				if (jobs[i].job_id < 10)
-					sprintf(time_string[jobs[i].core_id], "%d", jobs[i].job_id);
-				else if (jobs[i].job_id < 10 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 + 'a');
-				else if (jobs[i].job_id < 10 + 26 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 - 26 + 'A');
-				else
-					snprintf(time_string[jobs[i].core_id], 10, "(%d)", jobs[i].job_id);
-			}
-		}
-
-		for (i = 0; i < cores; i++)
-		{
-			// If the core is idle, print a '-'
-			if (time_string[i][0] == '\0')
-				strcpy(time_string[i], "-");
-
-			// Ensure we have enough memory
-			while (strlen(core_timing_diagram[i]) + strlen(time_string[i]) >= (unsigned int)core_timing_diagram_size)
-			{
-				core_timing_diagram_size *= 2;
-
-				for (j = 0; j < cores; j++)
-				{
-					core_timing_diagram[j] = realloc(core_timing_diagram[j], core_timing_diagram_size + 1);
-
-					if (core_timing_diagram[j] == NULL)
-					{
-						fprintf(stderr, "Out of memory.\n");
-						return 3;
-					}
-				}
-			}
-
-			strcat( core_timing_diagram[i], time_string[i] );
-		}
-
-
-		/*
-		 * 5. Print data!
-		 */
-		printf("At the end of time unit %d...\n", time);
-
-		for (i = 0; i < cores; i++)
-			printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
-
-		printf("\n");
-
-		printf("  Queue: ");
-		scheduler_show_queue();
-		printf("\n");
-		printf("\n");
-
-
-		/*
-		 * 6. Sanity Checking
-		 *
-		 * - If there's a job alive (needing to be ran) and all CPUs are idle, the scheduler failed to schedule properly.
-		 */
-		if (jobs_alive > 0 && cores_working == 0)
-		{
-			printf("All cores are idle and at least one job remains unscheduled.\n");
-			print_available_jobs(jobs, active_jobs);
-			return 3;
-		}
-
-
-		/*
-		 * 7. Increase time
-		 */
-		time++;
+		status = simulator_run_stream(&source, &config, &summary);
+		simulator_close_stream(&source);
+	}
+	else
+	{
+		status = simulator_run(&trace, &config, &summary);
+		simulator_free_trace(&trace);
 	}
 
+	if (status != 0)
+		return status;
 
-	printf("FINAL TIMING DIAGRAM:\n");
-	for (i = 0; i < cores; i++)
-		printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
-
-	printf("\n");
-	printf("Average Waiting Time: %.2f\n", scheduler_average_waiting_time());
-	printf("Average Turnaround Time: %.2f\n", scheduler_average_turnaround_time());
-	printf("Average Response Time: %.2f\n", scheduler_average_response_time());
-
-	scheduler_clean_up();
-
+	printf("Average Waiting Time: %.2f", summary.average_waiting_time);
+	print_percentiles(show_percentiles, &summary.waiting);
+	printf("Average Turnaround Time: %.2f", summary.average_turnaround_time);
+	print_percentiles(show_percentiles, &summary.turnaround);
+	printf("Average Response Time: %.2f", summary.average_response_time);
+	print_percentiles(show_percentiles, &summary.response);
 
-	free(quantum_clock);
-	for (i=0; i < cores; i++)
-		free(core_timing_diagram[i]);
-	free(core_timing_diagram);
-	free(jobs);
+	if (queues != QUEUE_GLOBAL)
+		printf("Steals: %lu\n", summary.steals);
 
 	return 0;
 }
@@ -0,0 +1,429 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "libsimulator/libsimulator.h"
+
+
+/*
+ * One configuration of the sweep and, once it has run, its results.
+ */
+typedef struct _sweep_run_t
+{
+	simulator_config_t config;
+	scheduler_summary_t summary;
+	int status;
+	int baseline;  // the global-queue run with the same scheme, cores and quantum, or -1
+} sweep_run_t;
+
+/*
+ * State shared by the worker threads. The trace and runs[] are only read,
+ * apart from each worker writing the results of the runs it claimed.
+ */
+typedef struct _sweep_t
+{
+	const simulator_trace_t *trace;
+	sweep_run_t *runs;
+	int num_runs;
+	int next_run;
+} sweep_t;
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-s <schemes>] [-c <cores>] [-q <quanta>] [-m <queues>] [-j <threads>] [-e] <input file> | -g <settings>\n", program_name);
+	fprintf(stderr, "       %s -s fcfs,sjf,rr -c 1-4 -q 1,2,4 examples/proc1.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -s  comma-separated schemes: fcfs, sjf, psjf, pri, ppri, rr or rr#, mlfq# or mlfq#:#,\n");
+	fprintf(stderr, "      cfs or cfs# (default: all but mlfq and cfs)\n");
+	fprintf(stderr, "  -c  comma-separated core counts or ranges, eg. 1-8,16 (default: 1-4)\n");
+	fprintf(stderr, "  -q  comma-separated quanta or ranges used for rr, and as the top-level quantum of mlfq#\n");
+	fprintf(stderr, "      (default: 1-10)\n");
+	fprintf(stderr, "  -m  comma-separated queue modes: global, head, tail (default: global); per-core modes\n");
+	fprintf(stderr, "      are compared with a global-queue run of the same configuration\n");
+	fprintf(stderr, "  -j  number of worker threads (default: one per online processor)\n");
+	fprintf(stderr, "  -e  run the simulations event-driven\n");
+	fprintf(stderr, "  -g  sweep a synthetic trace generated in-process instead of a file (settings as for tracegen)\n");
+}
+
+/*
+ * Parses a list such as "1-8,16" into values[] (allocated, stored in *values).
+ * Returns the number of values, -1 if the list is malformed or -2 if memory ran out.
+ */
+int parse_range_list(const char *list, int **values)
+{
+	int count = 0, capacity = 16;
+	int *out = malloc(capacity * sizeof(int));
+	const char *p = list;
+
+	if (out == NULL)
+		return -2;
+
+	while (*p != '\0')
+	{
+		char *end;
+		long low = strtol(p, &end, 10), high;
+
+		if (end == p || low <= 0)
+		{
+			free(out);
+			return -1;
+		}
+
+		high = low;
+		if (*end == '-')
+		{
+			p = end + 1;
+			high = strtol(p, &end, 10);
+
+			if (end == p || high < low)
+			{
+				free(out);
+				return -1;
+			}
+		}
+
+		for (; low <= high; low++)
+		{
+			if (count == capacity)
+			{
+				int *grown = realloc(out, capacity * 2 * sizeof(int));
+				if (grown == NULL)
+				{
+					free(out);
+					return -2;
+				}
+				out = grown;
+				capacity *= 2;
+			}
+			out[count++] = low;
+		}
+
+		if (*end == ',')
+			end++;
+		else if (*end != '\0')
+		{
+			free(out);
+			return -1;
+		}
+		p = end;
+	}
+
+	*values = out;
+	return count;
+}
+
+/*
+ * Worker thread: claims the next unrun configuration until there are none left.
+ */
+void *sweep_worker(void *arg)
+{
+	sweep_t *sweep = arg;
+	int i;
+
+	while ((i = __atomic_fetch_add(&sweep->next_run, 1, __ATOMIC_RELAXED)) < sweep->num_runs)
+	{
+		sweep_run_t *run = &sweep->runs[i];
+		run->status = simulator_run(sweep->trace, &run->config, &run->summary);
+	}
+
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	int c, i, j, k;
+	char *schemes = "fcfs,sjf,psjf,pri,ppri,rr";
+	char *core_list = "1-4", *quantum_list = "1-10", *mode_list = "global";
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int event_driven = 0, generate = 0;
+	tracegen_config_t generator;
+
+	tracegen_defaults(&generator);
+
+	/*
+	 * Parse command line options.
+	 */
+	while ((c = getopt(argc, argv, "s:c:q:m:j:eg:")) != -1)
+	{
+		switch (c)
+		{
+			case 's': schemes = optarg; break;
+			case 'c': core_list = optarg; break;
+			case 'q': quantum_list = optarg; break;
+			case 'm': mode_list = optarg; break;
+			case 'e': event_driven = 1; break;
+
+			case 'g':
+				if (tracegen_parse_spec(optarg, &generator) != 0)
+				{
+					print_usage(argv[0]);
+					return 1;
+				}
+				generate = 1;
+				break;
+
+			case 'j':
+				threads = atoi(optarg);
+
+				if (threads <= 0)
+				{
+					fprintf(stderr, "Option -j <threads> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - (generate ? 0 : 1))
+	{
+		fprintf(stderr, "A single input file, or -g <settings> and no file, is required.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (threads <= 0)
+		threads = 1;
+
+	int *cores, *quanta;
+	int num_cores = parse_range_list(core_list, &cores);
+	if (num_cores == -2)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 3;
+	}
+	if (num_cores <= 0)
+	{
+		fprintf(stderr, "Option -c <cores> requires positive numbers or ranges. (Eg: -c 1-8,16)\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	int num_quanta = parse_range_list(quantum_list, &quanta);
+	if (num_quanta == -2)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 3;
+	}
+	if (num_quanta <= 0)
+	{
+		fprintf(stderr, "Option -q <quanta> requires positive numbers or ranges. (Eg: -q 1-10)\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+
+	/*
+	 * Queue modes always include the global queue when another mode is asked for, as the baseline.
+	 */
+	queue_mode_t modes[3];
+	int num_modes = 0, has_global = 0;
+
+	char *modes_copy = strdup(mode_list);
+	char *saveptr;
+	char *name;
+	for (name = strtok_r(modes_copy, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr))
+	{
+		queue_mode_t mode;
+
+		if (simulator_parse_queues(name, &mode) != 0)
+		{
+			fprintf(stderr, "Unknown queue mode \"%s\".\n", name);
+			print_usage(argv[0]);
+			return 1;
+		}
+
+		for (k = 0; k < num_modes && modes[k] != mode; k++);
+		if (k == num_modes)
+			modes[num_modes++] = mode;
+		if (mode == QUEUE_GLOBAL)
+			has_global = 1;
+	}
+	free(modes_copy);
+
+	if (num_modes == 0)
+	{
+		fprintf(stderr, "Option -m <queues> requires at least one queue mode.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if (!has_global)
+	{
+		memmove(&modes[1], &modes[0], num_modes * sizeof(queue_mode_t));
+		modes[0] = QUEUE_GLOBAL;
+		num_modes++;
+	}
+
+
+	/*
+	 * Build the list of configurations: every scheme on every core count, RR and MLFQ once per
+	 * quantum unless the scheme names its own quantum (rr#, mlfq#:#).
+	 */
+	int num_runs = 0, capacity = 16;
+	sweep_run_t *runs = malloc(capacity * sizeof(sweep_run_t));
+	if (runs == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		return 3;
+	}
+
+	char *scheme_list = strdup(schemes);
+	for (name = strtok_r(scheme_list, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr))
+	{
+		scheme_t scheme;
+		int quantum = 0, levels = 0, per_quantum = 0;
+
+		int result = simulator_parse_scheme(name, &scheme, &quantum, &levels);
+		if ((result == -2 && strcasecmp(name, "RR") == 0) || (result == 0 && scheme == MLFQ && quantum == 0))
+			per_quantum = 1;
+		else if (result != 0)
+		{
+			fprintf(stderr, "Unknown scheme \"%s\".\n", name);
+			print_usage(argv[0]);
+			return 1;
+		}
+
+		for (i = 0; i < num_cores; i++)
+		{
+			for (j = 0; j < (per_quantum ? num_quanta : 1); j++)
+			{
+				int baseline = -1;
+
+				for (k = 0; k < num_modes; k++)
+				{
+					if (num_runs == capacity)
+					{
+						sweep_run_t *grown = realloc(runs, capacity * 2 * sizeof(sweep_run_t));
+						if (grown == NULL)
+						{
+							fprintf(stderr, "Out of memory.\n");
+							return 3;
+						}
+						runs = grown;
+						capacity *= 2;
+					}
+
+					sweep_run_t *run = &runs[num_runs];
+					run->config.cores = cores[i];
+					run->config.scheme = scheme;
+					run->config.quantum = per_quantum ? quanta[j] : quantum;
+					run->config.levels = levels;
+					run->config.event_driven = event_driven;
+					run->config.verbosity = VERBOSITY_SUMMARY;
+					run->config.queues = modes[k];
+					run->config.show_stats = 0;
+					run->status = 0;
+
+					if (modes[k] == QUEUE_GLOBAL)
+						baseline = num_runs;
+					run->baseline = baseline;
+					num_runs++;
+				}
+			}
+		}
+	}
+	free(scheme_list);
+	free(cores);
+	free(quanta);
+
+
+	/*
+	 * Load (or generate) the trace once; every simulation reads the same copy.
+	 */
+	simulator_trace_t trace;
+	int status;
+	if (generate)
+	{
+		tracegen_t gen;
+		tracegen_init(&gen, &generator);
+		status = simulator_generate_trace(&gen, &trace);
+	}
+	else
+		status = simulator_load_trace(argv[optind], &trace);
+	if (status != 0)
+		return status;
+
+
+	/*
+	 * Run the configurations on the worker threads.
+	 */
+	sweep_t sweep;
+	sweep.trace = &trace;
+	sweep.runs = runs;
+	sweep.num_runs = num_runs;
+	sweep.next_run = 0;
+
+	if (threads > num_runs)
+		threads = num_runs;
+
+	pthread_t *workers = malloc(threads * sizeof(pthread_t));
+	for (k = 0; k < threads; k++)
+	{
+		if (pthread_create(&workers[k], NULL, sweep_worker, &sweep) != 0)
+		{
+			fprintf(stderr, "Unable to start worker thread %d.\n", k);
+			threads = k;
+			break;
+		}
+	}
+
+	// With no worker started, run everything here
+	if (threads == 0)
+		sweep_worker(&sweep);
+
+	for (k = 0; k < threads; k++)
+		pthread_join(workers[k], NULL);
+	free(workers);
+
+
+	/*
+	 * Print the metrics table, in the order the configurations were listed.
+	 */
+	printf("Loaded %d job(s), ran %d configuration(s).\n\n", trace.num_jobs, num_runs);
+	printf("%-8s %5s %-7s %12s %12s %12s %6s %8s %10s %10s\n", "scheme", "cores", "queues",
+			"waiting", "turnaround", "response", "util", "steals", "d_waiting", "d_response");
+
+	for (i = 0; i < num_runs; i++)
+	{
+		sweep_run_t *run = &runs[i];
+		sweep_run_t *base = &runs[run->baseline];
+		char label[16];
+		simulator_scheme_name(run->config.scheme, run->config.quantum, run->config.levels, label, sizeof(label));
+
+		printf("%-8s %5d %-7s ", label, run->config.cores, simulator_queues_name(run->config.queues));
+
+		if (run->status != 0)
+		{
+			printf("%12s %12s %12s %6s %8s %10s %10s\n", "failed", "-", "-", "-", "-", "-", "-");
+			status = run->status;
+		}
+		else if (run->config.queues == QUEUE_GLOBAL || base->status != 0)
+			printf("%12.2f %12.2f %12.2f %5.1f%% %8s %10s %10s\n", run->summary.average_waiting_time,
+					run->summary.average_turnaround_time, run->summary.average_response_time,
+					100 * run->summary.utilization, "-", "-", "-");
+		else
+			printf("%12.2f %12.2f %12.2f %5.1f%% %8lu %+10.2f %+10.2f\n", run->summary.average_waiting_time,
+					run->summary.average_turnaround_time, run->summary.average_response_time,
+					100 * run->summary.utilization, run->summary.steals,
+					run->summary.average_waiting_time - base->summary.average_waiting_time,
+					run->summary.average_response_time - base->summary.average_response_time);
+	}
+
+	simulator_free_trace(&trace);
+	free(runs);
+
+	return status;
+}
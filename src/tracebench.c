@@ -0,0 +1,116 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "libsimulator/libsimulator.h"
+
+
+/*
+ * Compares the trace loaders on one file: each loads it several times and the fastest run is reported.
+ */
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-n <runs>] <input file>\n", program_name);
+	fprintf(stderr, "       %s -n 5 examples/proc1.csv\n", program_name);
+}
+
+double now()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Loads the file runs times and returns the fastest time, or -1 if loading failed.
+ * The last trace loaded is left in *trace.
+ */
+double time_loader(int (*load)(const char *, simulator_trace_t *), const char *file_name, int runs, simulator_trace_t *trace)
+{
+	double best = -1;
+	int i;
+
+	for (i = 0; i < runs; i++)
+	{
+		if (i > 0)
+			simulator_free_trace(trace);
+
+		double start = now();
+		if (load(file_name, trace) != 0)
+			return -1;
+
+		double elapsed = now() - start;
+		if (best < 0 || elapsed < best)
+			best = elapsed;
+	}
+
+	return best;
+}
+
+int main(int argc, char **argv)
+{
+	int c, runs = 3;
+
+	while ((c = getopt(argc, argv, "n:")) != -1)
+	{
+		switch (c)
+		{
+			case 'n':
+				runs = atoi(optarg);
+
+				if (runs <= 0)
+				{
+					fprintf(stderr, "Option -n <runs> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "A single input file is required.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	simulator_trace_t by_fgets, by_mmap;
+	double fgets_time = time_loader(simulator_load_trace_fgets, argv[optind], runs, &by_fgets);
+	if (fgets_time < 0)
+		return 2;
+
+	double mmap_time = time_loader(simulator_load_trace, argv[optind], runs, &by_mmap);
+	if (mmap_time < 0)
+		return 2;
+
+	// Both loaders must read the same jobs
+	if (by_fgets.num_jobs != by_mmap.num_jobs ||
+	    memcmp(by_fgets.jobs, by_mmap.jobs, by_mmap.num_jobs * sizeof(simulator_trace_job_t)) != 0)
+	{
+		fprintf(stderr, "The loaders disagree on the contents of \"%s\".\n", argv[optind]);
+		return 3;
+	}
+
+	printf("Loaded %d job(s), best of %d run(s):\n", by_mmap.num_jobs, runs);
+	printf("  fgets: %9.3f ms (%7.1f Mjobs/s)\n", fgets_time * 1e3, by_mmap.num_jobs / fgets_time / 1e6);
+	printf("  mmap:  %9.3f ms (%7.1f Mjobs/s)\n", mmap_time * 1e3, by_mmap.num_jobs / mmap_time / 1e6);
+	printf("  speedup: %.2fx\n", fgets_time / mmap_time);
+
+	simulator_free_trace(&by_fgets);
+	simulator_free_trace(&by_mmap);
+
+	return 0;
+}
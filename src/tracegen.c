@@ -0,0 +1,56 @@
+/*
+ * CS 241
+ * The University of Illinois
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libtracegen/libtracegen.h"
+
+
+/*
+ * All output goes through stdout with this buffer, so it is written out in large blocks.
+ */
+static char output_buffer[1 << 20];
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [<settings>]\n", program_name);
+	fprintf(stderr, "       %s n=1000000,seed=7,arrivals=bursty,runtime=pareto,pri=0-3 > trace.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Writes a synthetic trace to stdout. Settings are comma-separated key=value pairs:\n");
+	fprintf(stderr, "  n         number of jobs (default 1000)\n");
+	fprintf(stderr, "  seed      random seed; the same settings always give the same trace (default 1)\n");
+	fprintf(stderr, "  arrivals  poisson or bursty (default poisson)\n");
+	fprintf(stderr, "  rate      mean arrivals per time unit (default 0.5)\n");
+	fprintf(stderr, "  burst     mean jobs per burst for bursty arrivals (default 8)\n");
+	fprintf(stderr, "  runtime   exp or pareto (default exp)\n");
+	fprintf(stderr, "  mean      mean run time (default 10)\n");
+	fprintf(stderr, "  alpha     Pareto shape, above 1 (default 1.5)\n");
+	fprintf(stderr, "  pri       priority range lo-hi (default 0-9)\n");
+}
+
+int main(int argc, char **argv)
+{
+	tracegen_config_t config;
+	tracegen_t gen;
+	int arrival_time, run_time, priority;
+
+	tracegen_defaults(&config);
+
+	if (argc > 2 || (argc == 2 && tracegen_parse_spec(argv[1], &config) != 0))
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	setvbuf(stdout, output_buffer, _IOFBF, sizeof(output_buffer));
+
+	tracegen_init(&gen, &config);
+	printf("\"Arrival time\",\"Run time\",\"Priority\"\n");
+	while (tracegen_next(&gen, &arrival_time, &run_time, &priority))
+		printf("%d,%d,%d\n", arrival_time, run_time, priority);
+
+	return 0;
+}